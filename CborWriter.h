@@ -0,0 +1,168 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Utf8.h"
+
+using namespace std;
+
+// --- Streaming CBOR (RFC 8949) encoder ---
+
+// Writes items straight to a stream as they are produced; arrays and maps
+// whose size is not known up front use the indefinite-length forms.
+//
+// With string sharing on, the whole item is wrapped in a stringref namespace
+// (tags 256 and 25, http://cbor.schmorp.de/stringref): the first occurrence
+// of a string is written out and later ones become a reference to its index.
+// Results repeat a handful of type names, grammar symbols and member names
+// thousands of times, so most of the saving over JSON comes from here.
+// Decoders put every literal string long enough to benefit into their table,
+// so the encoder has to count them all; past MAX_TRACKED it keeps counting
+// but remembers no new strings, which bounds memory on inputs with many
+// distinct lexemes.
+class CborWriter {
+    static const size_t MAX_TRACKED = 1 << 16;
+
+    streambuf* out;
+    bool sharing;
+    unordered_map<string, uint64_t> table;  // major type byte + string -> index
+    uint64_t tableSize = 0;
+
+    void put(unsigned char byte) { out->sputc((char)byte); }
+
+    // Initial byte and argument of a data item (RFC 8949, 3)
+    void head(unsigned major, uint64_t value) {
+        unsigned char buf[9];
+        size_t n;
+        if (value < 24) { buf[0] = (unsigned char)(major << 5 | value); n = 1; }
+        else if (value <= 0xFF) { buf[0] = (unsigned char)(major << 5 | 24); n = 2; }
+        else if (value <= 0xFFFF) { buf[0] = (unsigned char)(major << 5 | 25); n = 3; }
+        else if (value <= 0xFFFFFFFFULL) { buf[0] = (unsigned char)(major << 5 | 26); n = 5; }
+        else { buf[0] = (unsigned char)(major << 5 | 27); n = 9; }
+        for (size_t i = n - 1; i > 0; --i, value >>= 8) buf[i] = (unsigned char)(value & 0xFF);
+        out->sputn((const char*)buf, n);
+    }
+
+    // Shortest string that earns a table slot at the given index: anything
+    // shorter would not be longer than the reference to it
+    static size_t minSharedLength(uint64_t index) {
+        if (index < 24) return 3;
+        if (index < 0x100) return 4;
+        if (index < 0x10000) return 5;
+        if (index < 0x100000000ULL) return 7;
+        return 11;
+    }
+
+    void writeString(unsigned major, string_view s) {
+        if (sharing && s.size() >= minSharedLength(tableSize)) {
+            string key;
+            key.reserve(s.size() + 1);
+            key += (char)major;
+            key.append(s.data(), s.size());
+            auto it = table.find(key);
+            if (it != table.end()) {
+                head(6, 25);
+                head(0, it->second);
+                return;
+            }
+            if (table.size() < MAX_TRACKED) table.emplace(move(key), tableSize);
+            ++tableSize;
+        }
+        head(major, s.size());
+        out->sputn(s.data(), s.size());
+    }
+
+public:
+    explicit CborWriter(ostream& os, bool shareStrings = true) : out(os.rdbuf()), sharing(shareStrings) {
+        if (sharing) head(6, 256);
+    }
+
+    CborWriter(const CborWriter&) = delete;
+    CborWriter& operator=(const CborWriter&) = delete;
+
+    void beginArray() { put(0x9F); }
+    void beginArray(uint64_t size) { head(4, size); }
+    void beginMap() { put(0xBF); }
+    void beginMap(uint64_t size) { head(5, size); }
+    // Closes an indefinite-length array, map or text string
+    void end() { put(0xFF); }
+
+    void integer(long long value) {
+        if (value >= 0) head(0, (uint64_t)value);
+        else head(1, (uint64_t)(-1 - value));
+    }
+
+    void boolean(bool value) { put(value ? 0xF5 : 0xF4); }
+
+    // Text that is not valid UTF-8 (the lexer splits characters it does not
+    // know into single bytes) goes out as a byte string, so no byte is lost
+    void text(string_view s) { writeString(validUtf8(s) ? 3 : 2, s); }
+    void key(string_view s) { text(s); }
+    void bytes(string_view s) { writeString(2, s); }
+
+    // Indefinite-length text string, written as chunks between beginText()
+    // and end(). Chunks are never shared.
+    void beginText() { put(0x7F); }
+    void textChunk(string_view s) {
+        if (validUtf8(s)) {
+            head(3, s.size());
+            out->sputn(s.data(), s.size());
+        } else {
+            string valid = toValidUtf8(s);
+            head(3, valid.size());
+            out->sputn(valid.data(), valid.size());
+        }
+    }
+};
+
+// Streams everything written through it as one indefinite-length text
+// string, a chunk per buffer-full, so a derivation of any size can be
+// encoded as it is generated. Every chunk has to be valid UTF-8 by itself:
+// a sequence cut by the end of the buffer moves on to the next chunk, and
+// ill-formed bytes become U+FFFD.
+class CborTextBuf : public streambuf {
+    CborWriter& writer;
+    char buffer[4096];
+
+    void emit(bool last) {
+        size_t n = pptr() - pbase();
+        size_t carry = last ? 0 : incompleteUtf8Tail(string_view(buffer, n));
+        if (n > carry) writer.textChunk(string_view(buffer, n - carry));
+        memmove(buffer, buffer + n - carry, carry);
+        setp(buffer, buffer + sizeof(buffer));
+        pbump((int)carry);
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        emit(false);
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    // Writers flush after every line (endl); a chunk per line would cost a
+    // header each, so flushing waits for the buffer to fill instead
+    int sync() override { return 0; }
+
+public:
+    explicit CborTextBuf(CborWriter& w) : writer(w) {
+        writer.beginText();
+        setp(buffer, buffer + sizeof(buffer));
+    }
+    ~CborTextBuf() override {
+        emit(true);
+        writer.end();
+    }
+};
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef CHUNKED_STREAM_H
+#define CHUNKED_STREAM_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// --- Streaming response bodies ---
+
+// Escapes everything written through it as the contents of a JSON string
+// and forwards the result to another stream, so large text (a derivation,
+// a tree dump) never has to exist unescaped and escaped at the same time.
+class JsonEscapeBuf : public streambuf {
+    streambuf* target;
+    char buffer[4096];
+
+    void escapeBuffered() {
+        const char* p = pbase();
+        const char* end = pptr();
+        const char* run = p;  // start of the current run of plain characters
+        for (; p < end; ++p) {
+            const char* esc = nullptr;
+            switch (*p) {
+                case '"': esc = "\\\""; break;
+                case '\\': esc = "\\\\"; break;
+                case '\b': esc = "\\b"; break;
+                case '\f': esc = "\\f"; break;
+                case '\n': esc = "\\n"; break;
+                case '\r': esc = "\\r"; break;
+                case '\t': esc = "\\t"; break;
+                default: continue;
+            }
+            target->sputn(run, p - run);
+            target->sputn(esc, 2);
+            run = p + 1;
+        }
+        target->sputn(run, end - run);
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        escapeBuffered();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        escapeBuffered();
+        return 0;
+    }
+
+public:
+    explicit JsonEscapeBuf(ostream& out) : target(out.rdbuf()) { setp(buffer, buffer + sizeof(buffer)); }
+    ~JsonEscapeBuf() override { escapeBuffered(); }
+};
+
+// Collects a body into a fixed buffer and hands it out as HTTP/1.1 chunks
+// (RFC 9112, 7.1) whenever the buffer fills. Nothing is emitted until the
+// first chunk is full, so a body that turns out to be small can still be
+// sent whole with a Content-Length. Once a handoff fails every later write
+// fails too, which puts the writing ostream into a bad state.
+class ChunkedEncoderBuf : public streambuf {
+    shared_ptr<vector<char>> buffer;
+    function<bool()> start;          // called once, before the first chunk
+    function<bool(string&&)> emit;   // receives framed chunks
+    bool started = false;
+    bool failed = false;
+    string trailers;                 // sent after the last chunk, each line ending in CRLF
+
+    string frame(const char* data, size_t len, bool last) const {
+        string out;
+        if (len) {
+            char size[24];
+            int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+            out.reserve(n + len + 2 + (last ? 5 + trailers.size() : 0));
+            out.append(size, n);
+            out.append(data, len);
+            out += "\r\n";
+        }
+        if (last) out += "0\r\n" + trailers + "\r\n";
+        return out;
+    }
+
+    bool emitBuffered(bool last) {
+        if (failed) return false;
+        if (!started) {
+            started = true;
+            if (!start()) failed = true;
+        }
+        size_t len = pptr() - pbase();
+        if (!failed && (len || last)) {
+            if (!emit(frame(pbase(), len, last))) failed = true;
+        }
+        setp(buffer->data(), buffer->data() + buffer->size());
+        return !failed;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!emitBuffered(false)) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    // Flushing the stream does not force out a short chunk
+    int sync() override { return failed ? -1 : 0; }
+
+public:
+    ChunkedEncoderBuf(size_t chunkSize, function<bool()> onStart, function<bool(string&&)> onChunk)
+        : buffer(make_shared<vector<char>>(chunkSize)), start(move(onStart)), emit(move(onChunk)) {
+        setp(buffer->data(), buffer->data() + buffer->size());
+    }
+
+    bool streaming() const { return started; }
+
+    // Bytes written but not yet handed out
+    string_view buffered() const { return string_view(pbase(), pptr() - pbase()); }
+
+    // Gives up the buffer behind buffered(), for when those bytes turn out
+    // to be the whole body and can be sent from where they are; nothing may
+    // be written to the encoder afterwards
+    shared_ptr<const vector<char>> releaseBuffer() {
+        setp(nullptr, nullptr);
+        return move(buffer);
+    }
+
+    // Emit the final chunk and the terminator with optional trailer fields;
+    // only valid once streaming
+    bool finish(const string& trailerFields = "") {
+        trailers = trailerFields;
+        return emitBuffered(true);
+    }
+};
+
+// Forwards everything except the last byte written, so the end of a
+// document (such as the closing brace of a JSON object) can still be
+// replaced once the writer is done.
+class HoldBackBuf : public streambuf {
+    streambuf* target;
+    char buffer[4096];
+
+    void forward() {
+        size_t len = pptr() - pbase();
+        if (len <= 1) return;
+        target->sputn(pbase(), len - 1);
+        buffer[0] = pptr()[-1];
+        setp(buffer, buffer + sizeof(buffer));
+        pbump(1);
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        forward();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        forward();
+        return 0;
+    }
+
+public:
+    explicit HoldBackBuf(ostream& out) : target(out.rdbuf()) { setp(buffer, buffer + sizeof(buffer)); }
+
+    // Forward all but the final byte and return it (0 if nothing was written).
+    // The caller writes whatever should replace it.
+    char takeLast() {
+        forward();
+        if (pptr() == pbase()) return 0;
+        char last = pptr()[-1];
+        setp(buffer, buffer + sizeof(buffer));
+        return last;
+    }
+};
+
+// Bytes spilled by all queues that share it, so that many slow clients
+// together cannot fill the disk. Bytes are reserved before they are written
+// and released when the queue holding them is destroyed.
+class SpillBudget {
+    atomic<size_t> used{0};
+    size_t limit;
+
+public:
+    explicit SpillBudget(size_t limitBytes) : limit(limitBytes) {}
+
+    bool reserve(size_t n) {
+        size_t current = used.load(memory_order_relaxed);
+        do {
+            if (current + n > limit) return false;
+        } while (!used.compare_exchange_weak(current, current + n, memory_order_relaxed));
+        return true;
+    }
+
+    void release(size_t n) { used.fetch_sub(n, memory_order_relaxed); }
+
+    size_t inUse() const { return used.load(memory_order_relaxed); }
+};
+
+// Handoff of encoded chunks from a producing thread to the thread that owns
+// the socket. The producer never waits for the consumer: once the queue
+// holds limit bytes in memory, further chunks are appended to an unlinked
+// temporary file and the consumer sends them from there, so a client that
+// reads slowly costs disk (usually page cache) instead of a thread. The
+// file is capped at spillLimit bytes and, if one is given, by a SpillBudget
+// shared with other queues; past either, or if the file cannot be written,
+// the response is cancelled. Where no file can be created the chunks stay
+// in memory, under the same caps. The file is written outside the lock, so
+// the consumer never waits for the disk; this relies on there being a
+// single producer. The consumer is told about new data through notify;
+// either side can cancel.
+class ChunkQueue {
+    struct Entry {
+        string data;        // in memory, or
+        size_t offset = 0;  // [offset, offset + length) of the spill file
+        size_t length = 0;
+    };
+
+    mutex mtx;
+    deque<Entry> entries;
+    size_t queuedBytes = 0;  // in memory
+    size_t limit;
+    size_t spillLimit;
+    SpillBudget* sharedBudget;
+    size_t spilledBytes = 0;  // reserved against both caps, written or not
+    int spillFd = -1;
+    bool spillFailed = false;
+    bool finished = false;
+    bool cancelled = false;
+    function<void()> notify;
+
+#ifndef _WIN32
+    static int openSpillFile() {
+        const char* dir = getenv("TMPDIR");
+        if (!dir || !*dir) dir = "/tmp";
+        int fd;
+#ifdef O_TMPFILE
+        fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd >= 0) return fd;
+#endif
+        string path = string(dir) + "/chunk-spill-XXXXXX";
+        fd = mkstemp(&path[0]);
+        if (fd >= 0) {
+            unlink(path.c_str());
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return fd;
+    }
+
+    // Writes chunk at offset of the spill file; false if it cannot be
+    // created or written. Called without the lock: only the producer touches
+    // the file before the chunk's entry is queued
+    bool spill(const string& chunk, size_t offset) {
+        if (spillFd < 0 && !spillFailed) {
+            int fd = openSpillFile();
+            lock_guard<mutex> lock(mtx);
+            spillFd = fd;
+            spillFailed = fd < 0;
+        }
+        if (spillFd < 0) return false;
+        size_t done = 0;
+        while (done < chunk.size()) {
+            ssize_t n = pwrite(spillFd, chunk.data() + done, chunk.size() - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+#else
+    bool spill(const string&, size_t) { return false; }
+#endif
+
+public:
+    enum Take { Data, Spilled, Empty, Finished, Cancelled };
+
+    ChunkQueue(size_t limitBytes, size_t spillLimitBytes, function<void()> onReady, SpillBudget* budget = nullptr)
+        : limit(limitBytes), spillLimit(spillLimitBytes), sharedBudget(budget), notify(move(onReady)) {}
+
+    ~ChunkQueue() {
+#ifndef _WIN32
+        if (spillFd >= 0) close(spillFd);
+#endif
+        if (sharedBudget) sharedBudget->release(spilledBytes);
+    }
+
+    ChunkQueue(const ChunkQueue&) = delete;
+    ChunkQueue& operator=(const ChunkQueue&) = delete;
+
+    // Producer: false if the consumer went away or the chunk could not be kept
+    bool push(string&& chunk) {
+        bool overLimit;
+        size_t offset = 0;
+        {
+            // Over the memory limit: reserve the chunk's place in the file
+            // against both caps, then write it without holding the lock
+            lock_guard<mutex> lock(mtx);
+            overLimit = !cancelled && queuedBytes >= limit;
+            if (overLimit) {
+                if (spilledBytes + chunk.size() > spillLimit ||
+                    (sharedBudget && !sharedBudget->reserve(chunk.size()))) {
+                    cancelled = true;
+                    overLimit = false;
+                } else {
+                    offset = spilledBytes;
+                    spilledBytes += chunk.size();
+                }
+            }
+        }
+        bool written = overLimit && spill(chunk, offset);
+        {
+            lock_guard<mutex> lock(mtx);
+            if (written && !cancelled) {
+                // Append to the last spilled entry when it ends where this chunk starts
+                if (!entries.empty() && entries.back().length &&
+                    entries.back().offset + entries.back().length == offset) {
+                    entries.back().length += chunk.size();
+                } else {
+                    Entry e;
+                    e.offset = offset;
+                    e.length = chunk.size();
+                    entries.push_back(move(e));
+                }
+                chunk.clear();
+            } else if (overLimit && !written && !spillFailed) {
+                cancelled = true;  // the file exists but could not be written
+            }
+            // Otherwise there is no file: the chunk stays in memory, already
+            // counted against the caps
+            if (!cancelled && !chunk.empty()) {
+                queuedBytes += chunk.size();
+                Entry e;
+                e.data = move(chunk);
+                entries.push_back(move(e));
+            }
+        }
+        notify();
+        return !isCancelled();
+    }
+
+    void finish() {
+        {
+            lock_guard<mutex> lock(mtx);
+            finished = true;
+        }
+        notify();
+    }
+
+    void cancel() {
+        {
+            lock_guard<mutex> lock(mtx);
+            cancelled = true;
+        }
+        notify();
+    }
+
+    bool isCancelled() {
+        lock_guard<mutex> lock(mtx);
+        return cancelled;
+    }
+
+    // Consumer: take the next chunk if there is one. Data is returned in out;
+    // a Spilled chunk is [offset, offset + length) of fileDescriptor()
+    Take take(string& out, size_t& offset, size_t& length) {
+        lock_guard<mutex> lock(mtx);
+        if (cancelled) return Cancelled;
+        if (entries.empty()) return finished ? Finished : Empty;
+        Entry& e = entries.front();
+        Take result = Data;
+        if (e.length) {
+            offset = e.offset;
+            length = e.length;
+            result = Spilled;
+        } else {
+            out = move(e.data);
+            queuedBytes -= out.size();
+        }
+        entries.pop_front();
+        return result;
+    }
+
+    // The spill file; valid for as long as the queue
+    int fileDescriptor() const { return spillFd; }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+using namespace std;
+
+// --- Minimal C++20 coroutine support for the event loop ---
+
+// A detached coroutine: it starts running as soon as it is called and frees
+// its own frame when it returns, so the caller keeps no handle to it.
+// Everything it uses after its first suspension must be owned by the frame
+// (copied arguments, shared_ptr), not borrowed from the caller.
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+};
+
+// The one coroutine waiting for an event, such as a socket becoming readable
+// or a send completing. The event source calls wake(); waking with nobody
+// waiting does nothing, so sources may report events nobody asked for.
+class Waiter {
+    coroutine_handle<> waiting;
+
+    struct Awaiter {
+        Waiter& waiter;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) noexcept { waiter.waiting = h; }
+        void await_resume() const noexcept {}
+    };
+
+public:
+    Waiter() {}
+    Waiter(const Waiter&) = delete;
+    Waiter& operator=(const Waiter&) = delete;
+
+    Awaiter operator co_await() { return Awaiter{*this}; }
+
+    // Resumes the waiting coroutine, if any; true if there was one
+    bool wake() {
+        if (!waiting) return false;
+        exchange(waiting, nullptr).resume();
+        return true;
+    }
+};
+
+// co_await Reschedule(post) continues the coroutine wherever post runs the
+// callable it is given, typically another thread. post returns false if it
+// refused the work; the coroutine then carries on where it was and the
+// co_await yields false.
+template <class Post>
+class Reschedule {
+    Post post;
+    bool accepted = true;
+
+public:
+    explicit Reschedule(Post p) : post(move(p)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(coroutine_handle<> h) {
+        // Once posted the coroutine may resume (and this awaiter go away)
+        // before post returns, so nothing here may be touched afterwards
+        // unless the work was refused
+        Post run = post;
+        if (run([h] { h.resume(); })) return true;
+        accepted = false;
+        return false;
+    }
+
+    bool await_resume() const noexcept { return accepted; }
+};
+
+#endif
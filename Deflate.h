@@ -0,0 +1,186 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// --- Minimal DEFLATE encoder (RFC 1951) with gzip/zlib framing ---
+// LZ77 with hash chains plus the fixed Huffman code. It is meant for
+// compressing static assets once at load time, so it favours simplicity
+// over ratio and needs no external library.
+
+class BitWriter {
+    string& out;
+    uint32_t bitBuf = 0;
+    int bitCount = 0;
+
+public:
+    explicit BitWriter(string& o) : out(o) {}
+
+    // Append the low n bits of value, least significant bit first
+    void putBits(uint32_t value, int n) {
+        bitBuf |= value << bitCount;
+        bitCount += n;
+        while (bitCount >= 8) {
+            out.push_back((char)(bitBuf & 0xFF));
+            bitBuf >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first
+    void putCode(uint32_t code, int len) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < len; ++i) {
+            reversed = (reversed << 1) | (code & 1);
+            code >>= 1;
+        }
+        putBits(reversed, len);
+    }
+
+    void flush() {
+        if (bitCount > 0) out.push_back((char)(bitBuf & 0xFF));
+        bitBuf = 0;
+        bitCount = 0;
+    }
+};
+
+static const int kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int kDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                  8193, 12289, 16385, 24577};
+static const int kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Fixed Huffman literal/length alphabet (RFC 1951, 3.2.6)
+inline void writeFixedSymbol(BitWriter& bw, int sym) {
+    if (sym < 144) bw.putCode(0x30 + sym, 8);
+    else if (sym < 256) bw.putCode(0x190 + (sym - 144), 9);
+    else if (sym < 280) bw.putCode(sym - 256, 7);
+    else bw.putCode(0xC0 + (sym - 280), 8);
+}
+
+inline void writeMatch(BitWriter& bw, int length, int distance) {
+    int li = 28;
+    while (kLengthBase[li] > length) --li;
+    writeFixedSymbol(bw, 257 + li);
+    if (kLengthExtra[li]) bw.putBits(length - kLengthBase[li], kLengthExtra[li]);
+
+    int di = 29;
+    while (kDistBase[di] > distance) --di;
+    bw.putCode(di, 5);
+    if (kDistExtra[di]) bw.putBits(distance - kDistBase[di], kDistExtra[di]);
+}
+
+// Raw DEFLATE stream, single fixed-Huffman block
+inline string deflateRaw(const string& in) {
+    const int WINDOW = 32768, MIN_MATCH = 3, MAX_MATCH = 258, MAX_CHAIN = 64;
+    const int HASH_BITS = 15, HASH_SIZE = 1 << HASH_BITS;
+
+    string out;
+    out.reserve(in.size() / 2 + 64);
+    BitWriter bw(out);
+    bw.putBits(1, 1);  // BFINAL
+    bw.putBits(1, 2);  // BTYPE = fixed Huffman
+
+    const unsigned char* data = (const unsigned char*)in.data();
+    const int n = (int)in.size();
+    vector<int> head(HASH_SIZE, -1);
+    vector<int> prev(WINDOW, -1);
+    auto hashAt = [&](int i) {
+        return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH_SIZE - 1);
+    };
+    auto insert = [&](int i) {
+        if (i + MIN_MATCH > n) return;
+        int h = hashAt(i);
+        prev[i % WINDOW] = head[h];
+        head[h] = i;
+    };
+
+    int i = 0;
+    while (i < n) {
+        int bestLen = 0, bestDist = 0;
+        if (i + MIN_MATCH <= n) {
+            int candidate = head[hashAt(i)];
+            int limit = min(MAX_MATCH, n - i);
+            for (int chain = 0; candidate >= 0 && i - candidate <= WINDOW && chain < MAX_CHAIN; ++chain) {
+                int len = 0;
+                while (len < limit && data[candidate + len] == data[i + len]) ++len;
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = i - candidate;
+                    if (len == limit) break;
+                }
+                int next = prev[candidate % WINDOW];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLen >= MIN_MATCH) {
+            writeMatch(bw, bestLen, bestDist);
+            for (int k = 0; k < bestLen; ++k) insert(i + k);
+            i += bestLen;
+        } else {
+            writeFixedSymbol(bw, data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+
+    writeFixedSymbol(bw, 256);  // end of block
+    bw.flush();
+    return out;
+}
+
+inline uint32_t crc32(const string& data) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (unsigned char ch : data) crc = table[(crc ^ ch) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+inline uint32_t adler32(const string& data) {
+    uint32_t a = 1, b = 0;
+    for (unsigned char ch : data) {
+        a = (a + ch) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Content-Encoding: gzip (RFC 1952)
+inline string gzipCompress(const string& in) {
+    string out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    out += deflateRaw(in);
+    uint32_t crc = crc32(in), size = (uint32_t)in.size();
+    for (int i = 0; i < 4; ++i) out.push_back((char)((crc >> (8 * i)) & 0xFF));
+    for (int i = 0; i < 4; ++i) out.push_back((char)((size >> (8 * i)) & 0xFF));
+    return out;
+}
+
+// Content-Encoding: deflate, which HTTP defines as the zlib format (RFC 1950)
+inline string zlibCompress(const string& in) {
+    string out("\x78\x01", 2);
+    out += deflateRaw(in);
+    uint32_t adler = adler32(in);
+    for (int i = 3; i >= 0; --i) out.push_back((char)((adler >> (8 * i)) & 0xFF));
+    return out;
+}
+
+#endif
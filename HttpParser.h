@@ -0,0 +1,250 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// --- HTTP/1.x request parsing ---
+
+struct HttpRequest {
+    string method;
+    string path;      // without the query string
+    string query;
+    string version;
+    vector<pair<string, string>> headers;
+    string body;
+    size_t wireBytes = 0;  // size on the wire, request line and headers included
+
+    // Header value by case-insensitive name, or "" if absent
+    string header(const string& name) const {
+        for (const auto& h : headers) {
+            if (h.first.size() != name.size()) continue;
+            bool match = true;
+            for (size_t i = 0; i < name.size() && match; ++i) {
+                match = tolower((unsigned char)h.first[i]) == tolower((unsigned char)name[i]);
+            }
+            if (match) return h.second;
+        }
+        return "";
+    }
+};
+
+// Incremental parser: bytes are fed as they arrive, in chunks of any size.
+// Each byte is examined once; the body goes straight into a buffer reserved
+// from Content-Length. feed() stops at the end of a request, so pipelined
+// bytes that follow are left to the caller for the next request.
+class HttpRequestParser {
+public:
+    enum Status { NeedMore, Complete, Failed };
+
+private:
+    enum State { RequestLine, Headers, Body, Done, Error };
+
+    size_t maxHeaderBytes;
+    size_t maxBodyBytes;
+    State state = RequestLine;
+    HttpRequest req;
+    string line;            // current, incomplete line
+    size_t headerBytes = 0;
+    size_t bodyRemaining = 0;
+    int errorCode = 0;
+    string errorText;
+
+    void fail(int code, const string& text) {
+        state = Error;
+        errorCode = code;
+        errorText = text;
+    }
+
+    static void trim(string& s) {
+        size_t b = s.find_first_not_of(" \t");
+        size_t e = s.find_last_not_of(" \t");
+        s = b == string::npos ? "" : s.substr(b, e - b + 1);
+    }
+
+    static bool equalsNoCase(const string& a, const char* b) {
+        size_t n = strlen(b);
+        if (a.size() != n) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+        }
+        return true;
+    }
+
+    void parseRequestLine() {
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == string::npos ? string::npos : line.find(' ', sp1 + 1);
+        if (sp1 == 0 || sp2 == string::npos || line.find(' ', sp2 + 1) != string::npos) {
+            fail(400, "Malformed request line");
+            return;
+        }
+        req.method = line.substr(0, sp1);
+        string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        req.version = line.substr(sp2 + 1);
+        if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+            fail(505, "HTTP Version Not Supported");
+            return;
+        }
+        size_t qmark = target.find('?');
+        req.path = target.substr(0, qmark);
+        req.query = qmark == string::npos ? "" : target.substr(qmark + 1);
+        state = Headers;
+    }
+
+    // tchar of RFC 9110, 5.6.2: what a field name may consist of
+    static bool isTokenChar(unsigned char c) {
+        return isalnum(c) || (c && strchr("!#$%&'*+-.^_`|~", c));
+    }
+
+    void parseHeaderLine() {
+        size_t colon = line.find(':');
+        if (colon == string::npos || colon == 0) {
+            fail(400, "Malformed header line");
+            return;
+        }
+        // No whitespace before the colon (RFC 9112, 5.1), nor anything else
+        // outside a token: "Content-Length : 5" must not pass for some other
+        // field and leave the body to be read as the next request
+        for (size_t i = 0; i < colon; ++i) {
+            if (!isTokenChar((unsigned char)line[i])) {
+                fail(400, "Malformed header name");
+                return;
+            }
+        }
+        string name = line.substr(0, colon);
+        string value = line.substr(colon + 1);
+        trim(value);
+        req.headers.emplace_back(move(name), move(value));
+    }
+
+    // Blank line: decide how the body is framed. Framing headers that
+    // disagree are rejected rather than resolved (RFC 9112, 6.3): reading
+    // the first of two Content-Lengths would let the rest of the body pass
+    // for a pipelined request.
+    void endHeaders() {
+        bool transferEncoding = false;
+        string cl;
+        for (const auto& h : req.headers) {
+            if (equalsNoCase(h.first, "Transfer-Encoding")) {
+                transferEncoding = true;
+            } else if (equalsNoCase(h.first, "Content-Length")) {
+                // A list of identical values (or repeated fields) is one length
+                size_t start = 0;
+                while (start <= h.second.size()) {
+                    size_t comma = h.second.find(',', start);
+                    if (comma == string::npos) comma = h.second.size();
+                    string value = h.second.substr(start, comma - start);
+                    trim(value);
+                    if (value.empty()) {
+                        fail(400, "Invalid Content-Length");
+                        return;
+                    }
+                    if (!cl.empty() && value != cl) {
+                        fail(400, "Conflicting Content-Length");
+                        return;
+                    }
+                    cl = value;
+                    start = comma + 1;
+                }
+            }
+        }
+        // Not even "identity", which RFC 9112 no longer defines as a coding
+        if (transferEncoding) {
+            fail(501, "Transfer-Encoding not supported, send Content-Length");
+            return;
+        }
+        size_t length = 0;
+        if (!cl.empty()) {
+            if (cl.size() > 19 || cl.find_first_not_of("0123456789") != string::npos) {
+                fail(400, "Invalid Content-Length");
+                return;
+            }
+            length = stoull(cl);
+        }
+        if (length > maxBodyBytes) {
+            fail(413, "Request body exceeds " + to_string(maxBodyBytes) + " bytes");
+            return;
+        }
+        req.body.reserve(length);
+        bodyRemaining = length;
+        state = length ? Body : Done;
+    }
+
+public:
+    HttpRequestParser(size_t maxHeader, size_t maxBody)
+        : maxHeaderBytes(maxHeader), maxBodyBytes(maxBody) {}
+
+    // Consume bytes until the request is complete or input runs out.
+    // Returns how many bytes were used.
+    size_t feed(const char* data, size_t len) {
+        size_t used = 0;
+        while (used < len && (state == RequestLine || state == Headers)) {
+            const char* nl = (const char*)memchr(data + used, '\n', len - used);
+            size_t take = nl ? (size_t)(nl - (data + used)) + 1 : len - used;
+            headerBytes += take;
+            if (headerBytes > maxHeaderBytes) {
+                fail(431, "Request headers exceed " + to_string(maxHeaderBytes) + " bytes");
+                return used + take;
+            }
+            line.append(data + used, take);
+            used += take;
+            if (!nl) break;
+
+            line.pop_back();                                   // '\n'
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (state == RequestLine) {
+                if (!line.empty()) parseRequestLine();          // tolerate leading blank lines
+            } else if (line.empty()) {
+                endHeaders();
+            } else {
+                parseHeaderLine();
+            }
+            line.clear();
+        }
+        if (state == Body && used < len) {
+            size_t take = min(bodyRemaining, len - used);
+            req.body.append(data + used, take);
+            used += take;
+            bodyRemaining -= take;
+            if (bodyRemaining == 0) state = Done;
+        }
+        return used;
+    }
+
+    Status status() const {
+        if (state == Done) return Complete;
+        if (state == Error) return Failed;
+        return NeedMore;
+    }
+
+    // Whether any bytes of the next request have arrived
+    bool started() const { return state != RequestLine || !line.empty(); }
+
+    int errorStatus() const { return errorCode; }
+    const string& errorMessage() const { return errorText; }
+
+    // Hand over the finished request and get ready for the next one
+    HttpRequest take() {
+        req.wireBytes = headerBytes + req.body.size();
+        HttpRequest done = move(req);
+        reset();
+        return done;
+    }
+
+    void reset() {
+        state = RequestLine;
+        req = HttpRequest();
+        line.clear();
+        headerBytes = 0;
+        bodyRemaining = 0;
+        errorCode = 0;
+        errorText.clear();
+    }
+};
+
+#endif
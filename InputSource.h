@@ -0,0 +1,153 @@
+#ifndef INPUT_SOURCE_H
+#define INPUT_SOURCE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// --- Fast standard input for the exercise programs ---
+// The exercises read their program with scanf("%c") a byte at a time. The
+// functions here read the same bytes in bulk instead: a regular file is
+// mapped (or read with one call), a pipe is read in large blocks.
+
+#ifndef _WIN32
+// read() that retries when interrupted; 0 at end of input, -1 on error
+inline ssize_t readRetrying(int fd, char* dst, size_t n) {
+    ssize_t got;
+    do {
+        got = read(fd, dst, n);
+    } while (got < 0 && errno == EINTR);
+    return got;
+}
+#endif
+
+// Appends everything left on standard input to prog, for the exercises
+// that need the whole program at once. A regular file is read with one
+// call straight into place (mapping it would still need the copy into
+// prog); a pipe is read 64 KiB, its usual capacity, at a time.
+inline void readAllInput(string& prog) {
+    char block[1 << 16];
+#ifdef _WIN32
+    // Text mode like scanf, so line endings come out the same
+    size_t got;
+    while ((got = fread(block, 1, sizeof(block), stdin)) > 0) prog.append(block, got);
+#else
+    struct stat st;
+    off_t at;
+    if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && (at = lseek(0, 0, SEEK_CUR)) >= 0 && st.st_size > at) {
+        size_t used = prog.size();
+        size_t want = (size_t)(st.st_size - at);
+        prog.resize(used + want);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = readRetrying(0, &prog[used + got], want - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        prog.resize(used + got);
+    }
+    // A pipe, or whatever a file grew by meanwhile
+    ssize_t n;
+    while ((n = readRetrying(0, block, sizeof(block))) > 0) prog.append(block, n);
+#endif
+}
+
+// Standard input handed out as a sequence of blocks for a consumer that
+// works through it front to back, such as a lexer. Each call to next()
+// can keep the unconsumed tail of the previous block (a token cut off by
+// the block boundary) at the front of the new one. A regular file is
+// mapped and handed out in windows with no copying, and pages already
+// consumed are dropped again; anything else is read into a buffer of
+// blockSize bytes that only grows when a single kept tail needs it. So
+// memory stays bounded by the block size or the longest token, whichever
+// is larger, however long the input is.
+class InputBlocks {
+    vector<char> buffer;
+    size_t filled = 0;
+    size_t blockSize;
+    bool atEnd = false;
+
+#ifndef _WIN32
+    char* mapped = nullptr;
+    size_t mappedSize = 0;
+    size_t handedOut = 0;       // end of the last window within the mapping
+    size_t window = blockSize;  // size of the windows handed out
+    size_t released = 0;        // pages before this were dropped again
+#endif
+
+public:
+    explicit InputBlocks(size_t blockBytes = 1 << 20) : blockSize(blockBytes) {
+#ifndef _WIN32
+        struct stat st;
+        if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && lseek(0, 0, SEEK_CUR) == 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+            if (p != MAP_FAILED) {
+                mapped = (char*)p;
+                mappedSize = (size_t)st.st_size;
+                madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+            }
+        }
+#endif
+    }
+
+    ~InputBlocks() {
+#ifndef _WIN32
+        if (mapped) munmap(mapped, mappedSize);
+#endif
+    }
+
+    InputBlocks(const InputBlocks&) = delete;
+    InputBlocks& operator=(const InputBlocks&) = delete;
+
+    // The next block, starting with the last keep bytes of the previous one
+    string_view next(size_t keep) {
+#ifndef _WIN32
+        if (mapped) {
+            size_t from = handedOut - keep;
+            // Pages before the kept tail will not be looked at again
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            size_t done = from / page * page;
+            if (done > released) {
+                madvise(mapped + released, done - released, MADV_DONTNEED);
+                released = done;
+            }
+            // A tail that fills half the window is one long token: widen the
+            // window, so the token is not rescanned once per block
+            if (keep * 2 > window) window *= 2;
+            handedOut = min(mappedSize, from + window);
+            atEnd = handedOut == mappedSize;
+            return string_view(mapped + from, handedOut - from);
+        }
+#endif
+        copy(buffer.begin() + (filled - keep), buffer.begin() + filled, buffer.begin());
+        filled = keep;
+        // A tail that fills half the buffer is one long token: make room
+        if (buffer.size() < blockSize || keep * 2 > buffer.size()) buffer.resize(max(blockSize, buffer.size() * 2));
+        while (!atEnd && filled < buffer.size()) {
+#ifdef _WIN32
+            size_t got = fread(buffer.data() + filled, 1, buffer.size() - filled, stdin);
+#else
+            ssize_t got = readRetrying(0, buffer.data() + filled, buffer.size() - filled);
+#endif
+            if (got <= 0) atEnd = true;
+            else filled += got;
+        }
+        return string_view(buffer.data(), filled);
+    }
+
+    // Whether the block last returned reaches the end of the input
+    bool finished() const { return atEnd; }
+};
+
+#endif
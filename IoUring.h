@@ -0,0 +1,210 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// --- io_uring over the raw system calls (no liburing) ---
+
+// One io_uring instance with its submission and completion rings mapped into
+// user space. Submission entries handed out by sqe() are published to the
+// kernel together by the next submit(), so a whole batch of accepts, sends
+// and closes costs a single io_uring_enter. Not thread-safe: the event loop
+// owns it.
+class IoUring {
+    int ringFd = -1;
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqeTail = 0;  // entries handed out, including the unpublished ones
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    static void* mapRing(int fd, size_t size, off_t offset) {
+        return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    }
+
+public:
+    IoUring() {}
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    // Creates the rings; the completion ring is four times the submission
+    // ring, since one multishot request can complete many times
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0) return false;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqMapSize = cqMapSize = max(sqMapSize, cqMapSize);
+        sqMap = mapRing(ringFd, sqMapSize, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) return false;
+        cqMap = single ? sqMap : mapRing(ringFd, cqMapSize, IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED) return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mapRing(ringFd, sqesSize, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = (char*)sqMap;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+        sqeTail = *sqTail;
+        // Entries are always used in ring order, so the indirection array
+        // can map slot i to entry i once and for all
+        unsigned* array = (unsigned*)(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sqEntries; ++i) array[i] = i;
+
+        char* cq = (char*)cqMap;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int fd() const { return ringFd; }
+
+    // A zeroed submission entry, submitting the pending batch first if the
+    // ring is full; null only if the kernel will not take any more yet
+    io_uring_sqe* sqe() {
+        if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            submit();
+            if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return nullptr;
+        }
+        io_uring_sqe* entry = &sqes[sqeTail & sqMask];
+        ++sqeTail;
+        memset(entry, 0, sizeof(*entry));
+        return entry;
+    }
+
+    // Publishes the entries handed out so far and, with waitFor > 0, blocks
+    // until that many completions are available. Returns -1 with errno set
+    // on failure (EINTR when a signal interrupted the wait).
+    int submit(unsigned waitFor = 0) {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        unsigned pending = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (pending == 0 && waitFor == 0) return 0;
+        return (int)syscall(__NR_io_uring_enter, ringFd, pending, waitFor,
+                            waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+
+    // Hands every available completion to f. Each one is copied and retired
+    // before f runs, so f may queue new submissions.
+    template <class F>
+    unsigned forEachCompletion(F f) {
+        unsigned count = 0;
+        while (true) {
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return count;
+            io_uring_cqe cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            ++count;
+            f(cqe);
+        }
+    }
+
+    int registerResource(unsigned opcode, void* arg, unsigned count) {
+        return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, count);
+    }
+};
+
+// Receive buffers registered with the kernel as a provided-buffer ring
+// (IORING_REGISTER_PBUF_RING). A receive that selects from the group takes
+// a free buffer by itself and reports its id in the completion flags, so a
+// multishot receive needs no buffer per connection; the buffer goes back
+// into the ring with recycle() once its bytes have been consumed.
+class IoUringBufferRing {
+    io_uring_buf_ring* ring = (io_uring_buf_ring*)MAP_FAILED;
+    size_t ringBytes = 0;
+    vector<char> storage;
+    unsigned count = 0;
+    size_t bufferSize = 0;
+    unsigned short tail = 0;
+
+    void add(unsigned id) {
+        // Entries start at the beginning of the ring. Not ring->bufs: in C++
+        // the header's flexible-array wrapper moves that member 8 bytes on.
+        io_uring_buf* buf = (io_uring_buf*)ring + (tail & (count - 1));
+        buf->addr = (uint64_t)(uintptr_t)data(id);
+        buf->len = (uint32_t)bufferSize;
+        buf->bid = (uint16_t)id;
+        ++tail;
+    }
+
+    void publish() { __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE); }
+
+public:
+    IoUringBufferRing() {}
+    IoUringBufferRing(const IoUringBufferRing&) = delete;
+    IoUringBufferRing& operator=(const IoUringBufferRing&) = delete;
+
+    ~IoUringBufferRing() {
+        if (ring != MAP_FAILED) munmap(ring, ringBytes);
+    }
+
+    // entries must be a power of two; fails on kernels before 5.19
+    bool init(IoUring& uring, unsigned short group, unsigned entries, size_t size) {
+        count = entries;
+        bufferSize = size;
+        ringBytes = entries * sizeof(io_uring_buf);
+        ring = (io_uring_buf_ring*)mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) return false;
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)ring;
+        reg.ring_entries = entries;
+        reg.bgid = group;
+        if (uring.registerResource(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+        storage.resize(entries * size);
+        for (unsigned id = 0; id < entries; ++id) add(id);
+        publish();
+        return true;
+    }
+
+    char* data(unsigned id) { return storage.data() + id * bufferSize; }
+
+    void recycle(unsigned id) {
+        add(id);
+        publish();
+    }
+};
+
+#endif
+
+#endif
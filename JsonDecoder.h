@@ -0,0 +1,285 @@
+#ifndef JSON_DECODER_H
+#define JSON_DECODER_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// --- Single-pass extraction of one string field from a JSON request body ---
+
+enum class JsonField { Found, Missing, Malformed };
+
+// Index of the first '"' or '\\' at or after i, or end if there is none.
+// Runs of plain characters are skipped 16 bytes at a time where SSE2 exists.
+inline size_t findQuoteOrEscape(const char* s, size_t i, size_t end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    for (; i + 16 <= end; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(s + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                  _mm_cmpeq_epi8(chunk, slash)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < end; ++i) {
+        if (s[i] == '"' || s[i] == '\\') return i;
+    }
+    return end;
+}
+
+inline int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline bool readHex4(string_view s, size_t i, unsigned& value) {
+    if (i + 4 > s.size()) return false;
+    value = 0;
+    for (size_t k = 0; k < 4; ++k) {
+        int h = hexValue(s[i + k]);
+        if (h < 0) return false;
+        value = (value << 4) | (unsigned)h;
+    }
+    return true;
+}
+
+inline char* writeUtf8(char* w, unsigned cp) {
+    if (cp < 0x80) {
+        *w++ = (char)cp;
+    } else if (cp < 0x800) {
+        *w++ = (char)(0xC0 | (cp >> 6));
+        *w++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *w++ = (char)(0xE0 | (cp >> 12));
+        *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *w++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *w++ = (char)(0xF0 | (cp >> 18));
+        *w++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *w++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return w;
+}
+
+// Index of the quote closing the JSON string that starts at i, or end if
+// the string is not terminated
+inline size_t findClosingQuote(string_view s, size_t i) {
+    while (true) {
+        size_t stop = findQuoteOrEscape(s.data(), i, s.size());
+        if (stop >= s.size() || s[stop] == '"') return stop;
+        i = stop + 2;  // the escaped character cannot close the string
+        if (i >= s.size()) return s.size();
+    }
+}
+
+// Decode the JSON string starting after the opening quote at i. The output is
+// written into a buffer sized up front from the encoded string (a decoded
+// string is never longer than its encoding), so there is no reallocation. On
+// success i is left after the closing quote. out may be null when the value
+// is only being skipped.
+inline bool decodeJsonString(string_view s, size_t& i, string* out) {
+    char* w = nullptr;
+    if (out) {
+        size_t close = findClosingQuote(s, i);
+        if (close >= s.size()) return false;
+        out->resize(close - i);
+        w = &(*out)[0];
+    }
+    while (true) {
+        size_t stop = findQuoteOrEscape(s.data(), i, s.size());
+        if (stop >= s.size()) return false;
+        if (w) {
+            memcpy(w, s.data() + i, stop - i);
+            w += stop - i;
+        }
+        i = stop + 1;
+        if (s[stop] == '"') break;
+
+        if (i >= s.size()) return false;
+        char esc = s[i++];
+        char ch;
+        switch (esc) {
+            case '"': ch = '"'; break;
+            case '\\': ch = '\\'; break;
+            case '/': ch = '/'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 't': ch = '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (!readHex4(s, i, cp)) return false;
+                i += 4;
+                // Surrogate pair
+                unsigned low;
+                if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < s.size() && s[i] == '\\' && s[i + 1] == 'u' &&
+                    readHex4(s, i + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                } else if (cp >= 0xD800 && cp < 0xE000) {
+                    // A lone surrogate has no UTF-8 form
+                    cp = 0xFFFD;
+                }
+                if (w) w = writeUtf8(w, cp);
+                continue;
+            }
+            default: return false;
+        }
+        if (w) *w++ = ch;
+    }
+    if (out) out->resize(w - out->data());
+    return true;
+}
+
+inline void skipSpace(string_view s, size_t& i) {
+    while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r')) ++i;
+}
+
+// Skip any JSON value (nested objects/arrays are tracked by depth only)
+inline bool skipJsonValue(string_view s, size_t& i) {
+    int depth = 0;
+    do {
+        skipSpace(s, i);
+        if (i >= s.size()) return false;
+        char c = s[i];
+        if (c == '"') {
+            ++i;
+            if (!decodeJsonString(s, i, nullptr)) return false;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+            ++i;
+        } else if (c == '}' || c == ']') {
+            if (--depth < 0) return false;
+            ++i;
+        } else if (c == ',' || c == ':') {
+            if (depth == 0) return false;
+            ++i;
+        } else {
+            // number, true, false, null
+            size_t start = i;
+            while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']' &&
+                   s[i] != ' ' && s[i] != '\t' && s[i] != '\n' && s[i] != '\r') ++i;
+            if (i == start) return false;
+        }
+    } while (depth > 0);
+    return true;
+}
+
+// Split a JSON array into the raw text of its elements (not decoded, so each
+// can be handed to decodeStringField on its own)
+inline bool splitJsonArray(string_view json, vector<string_view>& elements) {
+    size_t i = 0;
+    skipSpace(json, i);
+    if (i >= json.size() || json[i] != '[') return false;
+    ++i;
+    skipSpace(json, i);
+    if (i < json.size() && json[i] == ']') return true;
+    while (true) {
+        skipSpace(json, i);
+        size_t start = i;
+        if (!skipJsonValue(json, i)) return false;
+        elements.push_back(json.substr(start, i - start));
+        skipSpace(json, i);
+        if (i < json.size() && json[i] == ',') {
+            ++i;
+            continue;
+        }
+        if (i < json.size() && json[i] == ']') break;
+        return false;
+    }
+    ++i;
+    skipSpace(json, i);
+    return i == json.size();
+}
+
+// Walk the top-level members of a JSON object up to `key` and let parseValue
+// handle its value (with i at the first byte of the value). Every byte before
+// the value is examined once.
+template <class ParseValue>
+inline JsonField visitJsonMember(string_view json, string_view key, ParseValue parseValue) {
+    size_t i = 0;
+    skipSpace(json, i);
+    if (i >= json.size() || json[i] != '{') return JsonField::Malformed;
+    ++i;
+    while (true) {
+        skipSpace(json, i);
+        if (i < json.size() && json[i] == '}') return JsonField::Missing;
+        if (i >= json.size() || json[i] != '"') return JsonField::Malformed;
+        size_t keyStart = ++i;
+        if (!decodeJsonString(json, i, nullptr)) return JsonField::Malformed;
+        // Member names are short; only escaped ones need decoding
+        string_view rawName = json.substr(keyStart, i - 1 - keyStart);
+        bool matches = rawName == key;
+        if (!matches && rawName.find('\\') != string_view::npos) {
+            string name;
+            size_t k = 0;
+            decodeJsonString(json.substr(keyStart, i - keyStart), k, &name);
+            matches = name == key;
+        }
+        skipSpace(json, i);
+        if (i >= json.size() || json[i] != ':') return JsonField::Malformed;
+        ++i;
+        skipSpace(json, i);
+        if (matches) return parseValue(i) ? JsonField::Found : JsonField::Malformed;
+        if (!skipJsonValue(json, i)) return JsonField::Malformed;
+        skipSpace(json, i);
+        if (i < json.size() && json[i] == ',') {
+            ++i;
+            continue;
+        }
+        if (i < json.size() && json[i] == '}') return JsonField::Missing;
+        return JsonField::Malformed;
+    }
+}
+
+// Find the top-level string member `key` of a JSON object and decode it into
+// out, touching each byte of the body once.
+inline JsonField decodeStringField(string_view json, string_view key, string& out) {
+    return visitJsonMember(json, key, [&](size_t& i) {
+        if (i >= json.size() || json[i] != '"') return false;
+        ++i;
+        return decodeJsonString(json, i, &out);
+    });
+}
+
+// Raw (undecoded) text of the top-level member `key`, e.g. an array to be
+// split with splitJsonArray
+inline JsonField findJsonMember(string_view json, string_view key, string_view& raw) {
+    return visitJsonMember(json, key, [&](size_t& i) {
+        size_t start = i;
+        if (!skipJsonValue(json, i)) return false;
+        raw = json.substr(start, i - start);
+        return true;
+    });
+}
+
+// Integer member `key`; Malformed if it is present but not an integer
+inline JsonField decodeIntField(string_view json, string_view key, long long& out) {
+    string_view raw;
+    JsonField found = findJsonMember(json, key, raw);
+    if (found != JsonField::Found) return found;
+    bool negative = !raw.empty() && raw[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == raw.size() || raw.size() - i > 18) return JsonField::Malformed;
+    long long value = 0;
+    for (; i < raw.size(); ++i) {
+        if (raw[i] < '0' || raw[i] > '9') return JsonField::Malformed;
+        value = value * 10 + (raw[i] - '0');
+    }
+    out = negative ? -value : value;
+    return JsonField::Found;
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <map>
 #include <set>
 #include <algorithm>
+#include "InputSource.h"
 using namespace std;
 
 // 文法规则定义
@@ -286,7 +287,7 @@ void read_prog(string& prog) {
 
 void Analysis() {
     string prog;
-    read_prog(prog);
+    readAllInput(prog);  // 整块读入，代替read_prog逐字节scanf
     auto tokens = tokenize(prog);
 
     Parser p(tokens);
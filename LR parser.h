@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <string>
@@ -8,6 +9,7 @@
 #include <stack>
 #include <unordered_set>
 #include <unordered_map>
+#include "InputSource.h"
 using namespace std;
 
 // 解析模式定义
@@ -46,6 +48,15 @@ unordered_map<string, unordered_map<string, string>> action_table; // Will be po
 // GOTO表 - 状态到非终结符的跳转映射
 unordered_map<string, unordered_map<string, string>> goto_table; // Will be populated by generator
 
+// 分析表的一份副本。服务器分片运行时每个分片各持一份，线程经 activeLRTables 查自己分片的副本；
+// 未设置时查上面的全局表
+struct LRTables {
+    unordered_map<string, ReductionRule> reduction_rules;
+    unordered_map<string, unordered_map<string, string>> action_table;
+    unordered_map<string, unordered_map<string, string>> goto_table;
+};
+thread_local const LRTables* activeLRTables = nullptr;
+
 // 工具函数：按空格分割字符串，将换行识别为<endl>标记
 vector<string> split_string_by_space(const string& input_str) {
     vector<string> tokens;
@@ -92,9 +103,34 @@ private:
     stack<string> state_stack;
     vector<string> symbol_stack;
     vector<vector<string>> parse_results;
+    ostream& out;  // 错误信息与推导结果的输出流
+    // 每个分析步骤前调用一次，默认为空。嵌入方可借此限制分析时间（例如在超时时抛出异常），
+    // 本文件因此无需依赖任何服务端代码
+    function<void()> checkpoint;
+    
+    // 只读查表，不会向全局表中插入新项，可被多个线程同时调用
+    static string lookup(const unordered_map<string, unordered_map<string, string>>& table,
+                         const string& state, const string& symbol) {
+        auto row = table.find(state);
+        if (row == table.end()) return "";
+        auto cell = row->second.find(symbol);
+        return cell == row->second.end() ? "" : cell->second;
+    }
+
+    // 当前线程使用的分析表
+    static const unordered_map<string, unordered_map<string, string>>& actions() {
+        return activeLRTables ? activeLRTables->action_table : action_table;
+    }
+    static const unordered_map<string, unordered_map<string, string>>& gotos() {
+        return activeLRTables ? activeLRTables->goto_table : goto_table;
+    }
+    static const unordered_map<string, ReductionRule>& reductions() {
+        return activeLRTables ? activeLRTables->reduction_rules : reduction_rules;
+    }
     
 public:
-    Parser(const string& program) {
+    Parser(const string& program, ostream& os = cout, function<void()> onStep = nullptr)
+        : out(os), checkpoint(move(onStep)) {
         token_position = 0;
         line_number = 0;
         error_line_number = -1;
@@ -147,6 +183,8 @@ public:
         
         // 主解析循环
         while (true) {
+            if (checkpoint) checkpoint();
+
             // 跳过换行符
             if (tokens[token_position] == "<endl>") {
                 token_position++;
@@ -159,17 +197,10 @@ public:
             string lookup_token = get_token_type(current_token);
             
             // 获取ACTION
-            string action = "";
-            if (action_table.count(current_state) && 
-                action_table[current_state].count(lookup_token)) {
-                action = action_table[current_state][lookup_token];
-            }
+            string action = lookup(actions(), current_state, lookup_token);
             
             if (action == "") {
-                bool can_recover = false;
-                if (action_table.count(current_state) && action_table[current_state].count(";")) {
-                    can_recover = true;
-                }
+                bool can_recover = lookup(actions(), current_state, ";") != "";
 
                 if (current_mode == MODE_ERROR_CHECKING) {
                     int display_line = line_number + 1;
@@ -178,9 +209,9 @@ public:
                     }
                     
                     if (can_recover) {
-                        cout << "语法错误，第" << display_line << "行，缺少\";\"" << endl;
+                        out << "语法错误，第" << display_line << "行，缺少\";\"" << endl;
                     } else {
-                        cout << "语法错误，第" << display_line << "行" << endl;
+                        out << "语法错误，第" << display_line << "行" << endl;
                     }
                 } else if (current_mode == MODE_PARSE) {
                      if (can_recover) {
@@ -200,7 +231,7 @@ public:
             }
             else if (action[0] == 'r') {
                 // 规约操作
-                ReductionRule rule = reduction_rules[action];
+                ReductionRule rule = reductions().at(action);
                 
                 // 弹出栈中元素
                 for (int i = 0; i < rule.symbol_count; ++i) {
@@ -224,17 +255,13 @@ public:
                 parse_results.push_back(current_parse);
                 
                 // GOTO跳转
-                string goto_state = "";
-                if (goto_table.count(state_stack.top()) && 
-                    goto_table[state_stack.top()].count(rule.left_symbol)) {
-                    goto_state = goto_table[state_stack.top()][rule.left_symbol];
-                }
+                string goto_state = lookup(gotos(), state_stack.top(), rule.left_symbol);
                 state_stack.push(goto_state);
             }
             else if (action[0] == 'e') {
                 // 错误处理：检测到缺少分号
                 if (current_mode == MODE_ERROR_CHECKING) {
-                    cout << "语法错误，第4行，缺少\";\"" << endl;
+                    out << "语法错误，第4行，缺少\";\"" << endl;
                     return;  // 只输出错误信息，不进行解析
                 } else {
                     // 在解析模式下，插入分号并继续
@@ -257,9 +284,10 @@ public:
         // 如果是解析模式，输出结果
         if (current_mode == MODE_PARSE && !parse_results.empty()) {
             for (int i = parse_results.size() - 1; i >= 0; --i) {
-                cout << join_vector_to_string(parse_results[i]);
+                if (checkpoint) checkpoint();  // 推导过程的输出随输入长度平方增长，同样需要检查
+                out << join_vector_to_string(parse_results[i]);
                 if (i > 0) {
-                    cout << " => " << endl;
+                    out << " => " << endl;
                 }
             }
         }
@@ -269,12 +297,9 @@ public:
 // 分析主函数
 void Analysis() {
     string program_code;
-    char character;
     
-    // 读取输入程序
-    while (scanf("%c", &character) != EOF) {
-        program_code += character;
-    }
+    // 读取输入程序：整块读入，不再逐字节scanf
+    readAllInput(program_code);
     
     // 创建解析器
     Parser parser(program_code);
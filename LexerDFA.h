@@ -0,0 +1,668 @@
+#ifndef LEXER_DFA_H
+#define LEXER_DFA_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEX_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// --- Table-driven lexer for the C subset of the lexical analysis exercise ---
+// The whole token set (keywords, operators, numbers, comments, strings) is
+// compiled into one minimized DFA during compilation. Lexing a token is then
+// a loop of table lookups: classify the byte, take the transition, stop at
+// the dead state. Every state except the start states accepts, so the token
+// always ends exactly where the automaton dies and nothing is re-read.
+
+// What a token is, read off the state the automaton stopped in
+enum LexKind : uint8_t {
+    LEX_NONE, LEX_KEYWORD, LEX_IDENTIFIER, LEX_CONSTANT, LEX_OPERATOR, LEX_COMMENT,
+    LEX_QUOTE,    // a double quote, opening or closing a string
+    LEX_STRING,   // the text between the quotes (possibly empty)
+    LEX_SKIPPED   // counted as a token but not reported
+};
+
+struct LexSpelling {
+    string_view text;
+    uint8_t typeId;
+};
+
+// The token set with the type ids the exercise prescribes
+constexpr LexSpelling lexKeywords[] = {
+    {"auto",1}, {"break",2}, {"case",3}, {"char",4}, {"const",5},
+    {"continue",6}, {"default",7}, {"do",8}, {"double",9}, {"else",10},
+    {"enum",11}, {"extern",12}, {"float",13}, {"for",14}, {"goto",15},
+    {"if",16}, {"int",17}, {"long",18}, {"register",19}, {"return",20},
+    {"short",21}, {"signed",22}, {"sizeof",23}, {"static",24}, {"struct",25},
+    {"switch",26}, {"typedef",27}, {"union",28}, {"unsigned",29}, {"void",30},
+    {"volatile",31}, {"while",32}
+};
+
+// Every prefix of a longer operator is an operator itself, so the longest
+// match is always the one the automaton stops at
+constexpr LexSpelling lexOperators[] = {
+    {"-",33}, {"--",34}, {"-=",35}, {"->",36}, {"!",37},
+    {"!=",38}, {"%",39}, {"%=",40}, {"&",41}, {"&&",42},
+    {"&=",43}, {"(",44}, {")",45}, {"*",46}, {"*=",47},
+    {",",48}, {".",49}, {"/",50}, {"/=",51}, {":",52},
+    {";",53}, {"?",54}, {"[",55}, {"]",56}, {"^",57},
+    {"^=",58}, {"{",59}, {"|",60}, {"||",61}, {"|=",62},
+    {"}",63}, {"~",64}, {"+",65}, {"++",66}, {"+=",67},
+    {"<",68}, {"<<",69}, {"<<=",70}, {"<=",71}, {"=",72},
+    {"==",73}, {">",74}, {">=",75}, {">>",76}, {">>=",77}
+};
+
+constexpr uint8_t LEX_QUOTE_ID = 78, LEX_COMMENT_ID = 79, LEX_CONSTANT_ID = 80, LEX_IDENTIFIER_ID = 81;
+
+// The points where the lexers built on this table differ. A dialect is a
+// set of these flags, given to LexDFA and Lexer as an unsigned template
+// argument (an integer rather than a struct, so C++17 can take it).
+enum LexDialect : unsigned {
+    LEX_UNDERSCORE_IN_IDENTIFIERS = 1,
+    LEX_CARRIAGE_RETURN_IS_BLANK = 2,  // '\r' is skipped like a space and ends a // comment
+    LEX_STAR_IS_SKIPPED = 4,           // '*' is a token of its own that is never reported
+};
+
+// Builds the automaton. Only meant to run during compilation: LexDFA below
+// copies the parts it needs into tables of the exact size.
+class LexAutomaton {
+public:
+    static constexpr int MaxStates = 256;
+    static constexpr int MaxClasses = 96;
+
+    int stateCount = 0;
+    int classCount = 0;
+    int start = 0;        // state 0 is the dead state
+    int stringStart = 0;  // start state inside a string
+    // Plain arrays: the constant evaluator handles them far faster than
+    // std::array, whose every subscript is a function call
+    uint8_t byteClass[256] = {};
+    uint16_t next[MaxStates][MaxClasses] = {};
+    LexKind kind[MaxStates] = {};
+    uint8_t typeId[MaxStates] = {};
+
+    constexpr explicit LexAutomaton(unsigned d) : dialect(d) {
+        assignByteClasses();
+        build();
+        minimize();
+        mergeClasses();
+    }
+
+    constexpr bool isBlank(int b) const {
+        return b == ' ' || b == '\t' || b == '\n' || (b == '\r' && (dialect & LEX_CARRIAGE_RETURN_IS_BLANK));
+    }
+
+private:
+    unsigned dialect;  // LexDialect flags
+    uint8_t classByte[MaxClasses] = {};  // one byte of each class
+
+    static constexpr bool isLetter(int b) { return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z'); }
+    static constexpr bool isDigit(int b) { return b >= '0' && b <= '9'; }
+    constexpr bool startsIdentifier(int b) const { return isLetter(b) || (b == '_' && (dialect & LEX_UNDERSCORE_IN_IDENTIFIERS)); }
+    constexpr bool continuesIdentifier(int b) const { return startsIdentifier(b) || isDigit(b); }
+
+    static constexpr bool isSpelled(int b) {
+        for (const LexSpelling& s : lexKeywords)
+            if (s.text.find((char)b) != string_view::npos) return true;
+        for (const LexSpelling& s : lexOperators)
+            if (s.text.find((char)b) != string_view::npos) return true;
+        return string_view("\"/*.\n\r_").find((char)b) != string_view::npos;
+    }
+
+    // Bytes that occur in a spelling or steer the automaton get a class of
+    // their own; the rest only differ by being a letter, a digit, a blank
+    // or anything else. mergeClasses() folds together what ends up equal.
+    constexpr void assignByteClasses() {
+        int group[4] = {-1, -1, -1, -1};
+        for (int b = 0; b < 256; ++b) {
+            int g = isLetter(b) ? 0 : isDigit(b) ? 1 : isBlank(b) ? 2 : 3;
+            bool own = isSpelled(b);
+            int c = own ? -1 : group[g];
+            if (c < 0) {
+                c = classCount++;
+                classByte[c] = (uint8_t)b;
+                if (!own) group[g] = c;
+            }
+            byteClass[b] = (uint8_t)c;
+        }
+    }
+
+    constexpr int addState(LexKind k, uint8_t id) {
+        kind[stateCount] = k;
+        typeId[stateCount] = id;
+        return stateCount++;
+    }
+
+    constexpr int edge(int from, int b) const { return next[from][byteClass[b]]; }
+    constexpr void setEdge(int from, int b, int to) { next[from][byteClass[b]] = (uint16_t)to; }
+
+    constexpr int insert(string_view text, LexKind k, uint8_t id, LexKind prefixKind, uint8_t prefixId) {
+        int s = start;
+        for (char ch : text) {
+            int b = (uint8_t)ch;
+            if (!edge(s, b)) setEdge(s, b, addState(prefixKind, prefixId));
+            s = edge(s, b);
+        }
+        kind[s] = k;
+        typeId[s] = id;
+        return s;
+    }
+
+    constexpr void build() {
+        addState(LEX_NONE, 0);  // dead
+        start = addState(LEX_NONE, 0);
+        stringStart = addState(LEX_STRING, LEX_IDENTIFIER_ID);
+        int stringBody = addState(LEX_STRING, LEX_IDENTIFIER_ID);
+        int identifier = addState(LEX_IDENTIFIER, LEX_IDENTIFIER_ID);
+        int number = addState(LEX_CONSTANT, LEX_CONSTANT_ID);
+        int fraction = addState(LEX_CONSTANT, LEX_CONSTANT_ID);
+        int lineComment = addState(LEX_COMMENT, LEX_COMMENT_ID);
+        // An unterminated block comment runs to the end of the input, so
+        // its inner states accept as well
+        int blockComment = addState(LEX_COMMENT, LEX_COMMENT_ID);
+        int blockStar = addState(LEX_COMMENT, LEX_COMMENT_ID);
+        int blockEnd = addState(LEX_COMMENT, LEX_COMMENT_ID);
+        int quote = addState(LEX_QUOTE, LEX_QUOTE_ID);
+        int unknown = addState(LEX_OPERATOR, 0);
+        if (dialect & LEX_STAR_IS_SKIPPED) setEdge(start, '*', addState(LEX_SKIPPED, 0));
+
+        int keywordsBegin = stateCount;
+        for (const LexSpelling& s : lexKeywords) insert(s.text, LEX_KEYWORD, s.typeId, LEX_IDENTIFIER, LEX_IDENTIFIER_ID);
+        int keywordsEnd = stateCount;
+        for (const LexSpelling& s : lexOperators) {
+            if ((dialect & LEX_STAR_IS_SKIPPED) && s.text[0] == '*') continue;
+            insert(s.text, LEX_OPERATOR, s.typeId, LEX_OPERATOR, 0);
+        }
+        int slash = edge(start, '/');
+        setEdge(slash, '/', lineComment);
+        setEdge(slash, '*', blockComment);
+        setEdge(start, '"', quote);
+
+        for (int c = 0; c < classCount; ++c) {
+            int b = classByte[c];
+            next[stringStart][c] = next[stringBody][c] = (uint16_t)(b == '"' ? 0 : stringBody);
+            next[identifier][c] = (uint16_t)(continuesIdentifier(b) ? identifier : 0);
+            next[number][c] = (uint16_t)(isDigit(b) ? number : b == '.' ? fraction : 0);
+            next[fraction][c] = (uint16_t)(isDigit(b) ? fraction : 0);
+            bool lineEnd = b == '\n' || (b == '\r' && (dialect & LEX_CARRIAGE_RETURN_IS_BLANK));
+            next[lineComment][c] = (uint16_t)(lineEnd ? 0 : lineComment);
+            next[blockComment][c] = (uint16_t)(b == '*' ? blockStar : blockComment);
+            next[blockStar][c] = (uint16_t)(b == '/' ? blockEnd : b == '*' ? blockStar : blockComment);
+            // Keyword prefixes fall back to plain identifiers
+            for (int s = keywordsBegin; s < keywordsEnd; ++s) {
+                if (!next[s][c] && continuesIdentifier(b)) next[s][c] = (uint16_t)identifier;
+            }
+            if (!next[start][c]) {
+                if (isDigit(b)) next[start][c] = (uint16_t)number;
+                else if (startsIdentifier(b)) next[start][c] = (uint16_t)identifier;
+                else if (!isBlank(b)) next[start][c] = (uint16_t)unknown;
+            }
+        }
+    }
+
+    // Moore's partition refinement: start from the states grouped by what
+    // they accept and split groups until all members agree on the group
+    // every byte class leads to. States are grouped by a hash of that
+    // signature; two different signatures with the same hash stop the
+    // compilation instead of being merged.
+    static void signatureHashCollision() {}
+
+    // Heapsort of order[0, n) by hash; std::sort is only constexpr from C++20
+    static constexpr void sortByHash(int* order, int n, const uint64_t* hash) {
+        auto siftDown = [&](int root, int size) {
+            while (2 * root + 1 < size) {
+                int child = 2 * root + 1;
+                if (child + 1 < size && hash[order[child]] < hash[order[child + 1]]) ++child;
+                if (!(hash[order[root]] < hash[order[child]])) return;
+                int t = order[root];
+                order[root] = order[child];
+                order[child] = t;
+                root = child;
+            }
+        };
+        for (int i = n / 2 - 1; i >= 0; --i) siftDown(i, n);
+        for (int end = n - 1; end > 0; --end) {
+            int t = order[0];
+            order[0] = order[end];
+            order[end] = t;
+            siftDown(0, end);
+        }
+    }
+
+    constexpr void minimize() {
+        int block[MaxStates] = {};
+        for (int s = 0; s < stateCount; ++s) block[s] = kind[s] * 256 + typeId[s];
+        int blocks = -1;
+        while (true) {
+            uint64_t hash[MaxStates] = {};
+            int order[MaxStates] = {};
+            for (int s = 0; s < stateCount; ++s) {
+                uint64_t h = (uint64_t)block[s];
+                for (int c = 0; c < classCount; ++c) h = h * 1000003u + (uint64_t)block[next[s][c]];
+                hash[s] = h;
+                order[s] = s;
+            }
+            sortByHash(order, stateCount, hash);
+            int refined[MaxStates] = {};
+            int count = 0;
+            for (int i = 0; i < stateCount; ++i) {
+                int s = order[i];
+                if (i > 0) {
+                    int prev = order[i - 1];
+                    if (hash[prev] != hash[s]) {
+                        ++count;
+                    } else {
+                        bool same = block[prev] == block[s];
+                        for (int c = 0; c < classCount && same; ++c) same = block[next[prev][c]] == block[next[s][c]];
+                        if (!same) signatureHashCollision();
+                    }
+                }
+                refined[s] = count;
+            }
+            ++count;
+            for (int s = 0; s < stateCount; ++s) block[s] = refined[s];
+            if (count == blocks) break;
+            blocks = count;
+        }
+
+        // Renumber the groups in order of their first state, so the dead
+        // state stays 0
+        int renumbered[MaxStates] = {};
+        int first[MaxStates] = {};
+        for (int b = 0; b < blocks; ++b) renumbered[b] = -1;
+        int count = 0;
+        for (int s = 0; s < stateCount; ++s) {
+            if (renumbered[block[s]] < 0) {
+                renumbered[block[s]] = count;
+                first[count++] = s;
+            }
+        }
+        // first[n] <= n, so rows can be moved down in place
+        for (int n = 0; n < count; ++n) {
+            int s = first[n];
+            for (int c = 0; c < classCount; ++c) next[n][c] = (uint16_t)renumbered[block[next[s][c]]];
+            kind[n] = kind[s];
+            typeId[n] = typeId[s];
+        }
+        start = renumbered[block[start]];
+        stringStart = renumbered[block[stringStart]];
+        stateCount = count;
+    }
+
+    // Byte classes that every state treats alike become one class
+    constexpr void mergeClasses() {
+        int merged[MaxClasses] = {};
+        int count = 0;
+        for (int c = 0; c < classCount; ++c) {
+            merged[c] = -1;
+            // Columns 0..count-1 already hold the distinct classes so far
+            for (int e = 0; e < count && merged[c] < 0; ++e) {
+                bool same = true;
+                for (int s = 0; s < stateCount && same; ++s) same = next[s][c] == next[s][e];
+                if (same) merged[c] = e;
+            }
+            if (merged[c] < 0) {
+                merged[c] = count++;
+                for (int s = 0; s < stateCount; ++s) next[s][merged[c]] = next[s][c];
+            }
+        }
+        for (int b = 0; b < 256; ++b) byteClass[b] = (uint8_t)merged[byteClass[b]];
+        classCount = count;
+    }
+};
+
+// --- Skipping runs of bytes that keep the automaton where it is ---
+// Inside an identifier, a number, a comment or a string most bytes lead
+// back to the same state. Such a run is described either by the few bytes
+// that end it or by the ranges of bytes that continue it, and is skipped
+// 16 or 32 bytes at a time with SSE4.2 or AVX2, whichever the CPU has.
+
+enum LexRunMode : uint8_t {
+    LEX_RUN_NONE,
+    LEX_RUN_UNTIL,  // runs until one of bytes[0..count)
+    LEX_RUN_WHILE   // runs while inside one of the ranges bytes[2i]..bytes[2i+1]
+};
+
+struct LexRun {
+    LexRunMode mode = LEX_RUN_NONE;
+    uint8_t count = 0;      // stop bytes, or range bounds (two per range)
+    uint8_t bytes[8] = {};  // unused slots repeat the first byte or range
+    uint8_t stay[32] = {};  // the bytes that continue the run, as a bitmap
+
+    constexpr bool stays(uint8_t b) const { return (stay[b >> 3] >> (b & 7)) & 1; }
+
+    // The run for the set of bytes staysFor(b) holds for, if it can be
+    // searched for with at most four stop bytes or four ranges. Sets of
+    // fewer than minInside bytes make runs too short to be worth it.
+    template <class Stays>
+    static constexpr LexRun of(Stays staysFor, int minInside = 8) {
+        LexRun run;
+        int inside = 0, exits = 0, ranges = 0;
+        for (int b = 0; b < 256; ++b) {
+            if (staysFor(b)) {
+                run.stay[b >> 3] |= (uint8_t)(1 << (b & 7));
+                ++inside;
+                if (b == 0 || !staysFor(b - 1)) ++ranges;
+            } else {
+                ++exits;
+            }
+        }
+        if (inside < minInside) return run;
+        if (exits >= 1 && exits <= 4) {
+            run.mode = LEX_RUN_UNTIL;
+            for (int b = 0; b < 256; ++b)
+                if (!run.stays((uint8_t)b)) run.bytes[run.count++] = (uint8_t)b;
+            for (int i = run.count; i < 4; ++i) run.bytes[i] = run.bytes[0];
+        } else if (ranges <= 4) {
+            run.mode = LEX_RUN_WHILE;
+            for (int b = 0; b < 256; ++b) {
+                if (!run.stays((uint8_t)b)) continue;
+                if (b == 0 || !run.stays((uint8_t)(b - 1))) run.bytes[run.count++] = (uint8_t)b;
+                if (b == 255 || !run.stays((uint8_t)(b + 1))) run.bytes[run.count++] = (uint8_t)b;
+            }
+            for (int i = run.count; i < 8; ++i) run.bytes[i] = run.bytes[i % 2];
+        }
+        return run;
+    }
+};
+
+inline const char* lexSkipRunScalar(const LexRun& run, const char* p, const char* end) {
+    while (p < end && run.stays((uint8_t)*p)) ++p;
+    return p;
+}
+
+#ifdef LEX_SIMD_X86
+// Most runs (identifiers, short comments) end within a few bytes, and
+// there a byte at a time is cheaper than any vector setup
+inline const char* lexSkipShortRun(const LexRun& run, const char* p, const char* end, bool& ended) {
+    for (const char* stop = min(p + 4, end); p < stop; ++p)
+        if (!run.stays((uint8_t)*p)) {
+            ended = true;
+            return p;
+        }
+    ended = p == end;
+    return p;
+}
+
+// One 16-byte block with pcmpestri: the offset of the first byte that ends
+// the run, 16 if there is none. Explicit lengths, so NUL bytes in the input
+// are ordinary bytes.
+__attribute__((target("sse4.2")))
+inline int lexRunEndSSE42(const LexRun& run, __m128i needle, const char* p) {
+    __m128i data = _mm_loadu_si128((const __m128i*)p);
+    if (run.mode == LEX_RUN_UNTIL)
+        return _mm_cmpestri(needle, run.count, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    return _mm_cmpestri(needle, run.count, data, 16,
+                        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+}
+
+__attribute__((target("sse4.2")))
+inline const char* lexSkipRunSSE42(const LexRun& run, const char* p, const char* end) {
+    bool ended;
+    p = lexSkipShortRun(run, p, end, ended);
+    if (ended) return p;
+    __m128i needle = _mm_loadl_epi64((const __m128i*)run.bytes);
+    for (; end - p >= 16; p += 16) {
+        int i = lexRunEndSSE42(run, needle, p);
+        if (i < 16) return p + i;
+    }
+    return lexSkipRunScalar(run, p, end);
+}
+
+__attribute__((target("avx2,sse4.2")))
+inline const char* lexSkipRunAVX2(const LexRun& run, const char* p, const char* end) {
+    // Runs too short to pay for setting up 256-bit vectors end in the first
+    // bytes or the first 16-byte block
+    bool ended;
+    p = lexSkipShortRun(run, p, end, ended);
+    if (ended) return p;
+    if (end - p >= 16) {
+        int i = lexRunEndSSE42(run, _mm_loadl_epi64((const __m128i*)run.bytes), p);
+        if (i < 16) return p + i;
+        p += 16;
+    }
+    if (run.mode == LEX_RUN_UNTIL) {
+        __m256i b0 = _mm256_set1_epi8((char)run.bytes[0]), b1 = _mm256_set1_epi8((char)run.bytes[1]);
+        __m256i b2 = _mm256_set1_epi8((char)run.bytes[2]), b3 = _mm256_set1_epi8((char)run.bytes[3]);
+        for (; end - p >= 32; p += 32) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)p);
+            __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(d, b0), _mm256_cmpeq_epi8(d, b1)),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(d, b2), _mm256_cmpeq_epi8(d, b3)));
+            unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+            if (mask) return p + __builtin_ctz(mask);
+        }
+    } else {
+        // b is in [lo, hi] exactly when (b - lo) wraps to at most hi - lo
+        __m256i lo0 = _mm256_set1_epi8((char)run.bytes[0]), w0 = _mm256_set1_epi8((char)(run.bytes[1] - run.bytes[0]));
+        __m256i lo1 = _mm256_set1_epi8((char)run.bytes[2]), w1 = _mm256_set1_epi8((char)(run.bytes[3] - run.bytes[2]));
+        __m256i lo2 = _mm256_set1_epi8((char)run.bytes[4]), w2 = _mm256_set1_epi8((char)(run.bytes[5] - run.bytes[4]));
+        __m256i lo3 = _mm256_set1_epi8((char)run.bytes[6]), w3 = _mm256_set1_epi8((char)(run.bytes[7] - run.bytes[6]));
+        for (; end - p >= 32; p += 32) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)p);
+            __m256i o0 = _mm256_sub_epi8(d, lo0), o1 = _mm256_sub_epi8(d, lo1);
+            __m256i o2 = _mm256_sub_epi8(d, lo2), o3 = _mm256_sub_epi8(d, lo3);
+            __m256i in = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(o0, w0), w0), _mm256_cmpeq_epi8(_mm256_max_epu8(o1, w1), w1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(o2, w2), w2), _mm256_cmpeq_epi8(_mm256_max_epu8(o3, w3), w3)));
+            unsigned mask = ~(unsigned)_mm256_movemask_epi8(in);
+            if (mask) return p + __builtin_ctz(mask);
+        }
+    }
+    return lexSkipRunScalar(run, p, end);
+}
+#endif
+
+typedef const char* (*LexSkipRunFn)(const LexRun&, const char*, const char*);
+
+inline LexSkipRunFn chooseLexSkipRun() {
+#ifdef LEX_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return lexSkipRunAVX2;
+    if (__builtin_cpu_supports("sse4.2")) return lexSkipRunSSE42;
+#endif
+    return lexSkipRunScalar;
+}
+
+// Returns the first byte in [p, end) that does not continue the run
+inline const LexSkipRunFn lexSkipRun = chooseLexSkipRun();
+
+// The automaton for one dialect as flat tables. States are stored
+// premultiplied by the number of byte classes, so a transition is
+// next[state + byteClass[byte]] and the dead state is 0. A state's
+// transitions back to itself carry RUN_FLAG when the rest of the run can
+// be skipped with lexSkipRun.
+template <unsigned D>
+class LexDFA {
+    static constexpr LexAutomaton automaton{D};
+
+    static constexpr LexRun runOfState(int s) {
+        if (s == 0) return LexRun{};  // the dead state is never scanned from
+        return LexRun::of([s](int b) { return automaton.next[s][automaton.byteClass[b]] == s; });
+    }
+
+public:
+    static constexpr int stateCount = automaton.stateCount;
+    static constexpr int classCount = automaton.classCount;
+    static constexpr uint16_t RUN_FLAG = 0x8000;
+    static_assert(stateCount * classCount <= RUN_FLAG, "premultiplied states must fit in 15 bits");
+
+    static constexpr uint16_t start = (uint16_t)(automaton.start * classCount);
+    static constexpr uint16_t stringStart = (uint16_t)(automaton.stringStart * classCount);
+    static constexpr array<uint8_t, 256> byteClass = [] {
+        array<uint8_t, 256> t{};
+        for (int b = 0; b < 256; ++b) t[b] = automaton.byteClass[b];
+        return t;
+    }();
+
+    // Index into runs for each state (for states without one, unused)
+    static constexpr array<uint8_t, stateCount> runOf = [] {
+        array<uint8_t, stateCount> t{};
+        int count = 0;
+        for (int s = 0; s < stateCount; ++s)
+            if (runOfState(s).mode != LEX_RUN_NONE) t[s] = (uint8_t)count++;
+        return t;
+    }();
+
+    static constexpr int runCount = [] {
+        int count = 0;
+        for (int s = 0; s < stateCount; ++s) count += runOfState(s).mode != LEX_RUN_NONE;
+        return count;
+    }();
+
+    static constexpr array<LexRun, runCount> runs = [] {
+        array<LexRun, runCount> t{};
+        int count = 0;
+        for (int s = 0; s < stateCount; ++s)
+            if (runOfState(s).mode != LEX_RUN_NONE) t[count++] = runOfState(s);
+        return t;
+    }();
+
+    static constexpr array<uint16_t, stateCount * classCount> next = [] {
+        array<uint16_t, stateCount * classCount> t{};
+        for (int s = 0; s < stateCount; ++s)
+            for (int c = 0; c < classCount; ++c) {
+                int to = automaton.next[s][c];
+                t[s * classCount + c] = (uint16_t)(to * classCount);
+                if (to == s && runOfState(s).mode != LEX_RUN_NONE) t[s * classCount + c] |= RUN_FLAG;
+            }
+        return t;
+    }();
+
+    static constexpr array<LexKind, stateCount> kind = [] {
+        array<LexKind, stateCount> t{};
+        for (int s = 0; s < stateCount; ++s) t[s] = automaton.kind[s];
+        return t;
+    }();
+
+    static constexpr array<uint8_t, stateCount> typeId = [] {
+        array<uint8_t, stateCount> t{};
+        for (int s = 0; s < stateCount; ++s) t[s] = automaton.typeId[s];
+        return t;
+    }();
+
+    // Whitespace skipped between tokens
+    static constexpr array<bool, 256> blank = [] {
+        array<bool, 256> t{};
+        for (int b = 0; b < 256; ++b) t[b] = automaton.isBlank(b);
+        return t;
+    }();
+
+    static constexpr LexRun blankRun = LexRun::of([](int b) { return automaton.isBlank(b); }, 1);
+
+    // Skips the whitespace at p; a single blank (the usual case) is
+    // handled without calling out to lexSkipRun
+    static const char* skipBlank(const char* p, const char* end) {
+        if (p < end && blank[(uint8_t)*p]) {
+            ++p;
+            if (p < end && blank[(uint8_t)*p]) p = lexSkipRun(blankRun, p + 1, end);
+        }
+        return p;
+    }
+
+    // Follows the automaton from state over [p, end) until it dies or the
+    // input ends. Returns where the token ends; state is left at the last
+    // live state, which says what the token is.
+    static const char* scan(uint16_t& state, const char* p, const char* end) {
+        uint16_t s = state;
+        for (; p < end; ++p) {
+            uint16_t t = next[s + byteClass[(uint8_t)*p]];
+            if (!t) break;
+            if (t & RUN_FLAG) {
+                t &= ~RUN_FLAG;
+                p = lexSkipRun(runs[runOf[t / classCount]], p + 1, end) - 1;
+            }
+            s = t;
+        }
+        state = s;
+        return p;
+    }
+
+    static LexKind kindOf(uint16_t state) { return kind[state / classCount]; }
+    static uint8_t typeIdOf(uint16_t state) { return typeId[state / classCount]; }
+};
+
+// A token as a position in the source rather than a copy of its text:
+// 16 bytes, no allocation, and the lexeme is a view made on demand
+struct LexToken {
+    uint32_t offset;  // into the source
+    uint32_t length;
+    uint32_t line;    // 1-based line the token starts on
+    LexKind kind;
+    uint8_t typeId;
+};
+
+// One lexing job over a buffer it borrows; the buffer must outlive it and
+// be under 4 GiB. All of its state is here, so any number of them can run
+// at once on different threads.
+//
+// The source can also arrive in blocks: a lexer told its block is not
+// complete holds back a token that runs into the end of the block, since
+// more input could still extend it, and resume() carries on in the next
+// block, which must start with the remaining() bytes held back. Token
+// offsets are then into the current block.
+template <unsigned D>
+class Lexer {
+public:
+    typedef LexDFA<D> DFA;
+
+    explicit Lexer(string_view source, bool complete = true)
+        : begin(source.data()), pos(source.data()), end(source.data() + source.size()), complete(complete) {}
+
+    // Recognizes the next token; false once only whitespace is left
+    bool next(LexToken& token) {
+        pos = DFA::skipBlank(pos, end);
+        if (pos >= end) return false;
+        const char* first = pos;
+        uint16_t state = quoteStatus == 1 ? DFA::stringStart : DFA::start;
+        pos = DFA::scan(state, pos, end);
+        if (pos == end && !complete) {
+            pos = first;
+            return false;
+        }
+        // Lines are counted lazily, each byte once, up to where a token starts
+        line += (uint32_t)count(lineCounted, first, '\n');
+        lineCounted = first;
+        token.offset = (uint32_t)(first - begin);
+        token.length = (uint32_t)(pos - first);
+        token.line = line;
+        token.kind = DFA::kindOf(state);
+        token.typeId = DFA::typeIdOf(state);
+        if (token.kind == LEX_STRING) quoteStatus = 2;
+        else if (token.kind == LEX_QUOTE) quoteStatus = quoteStatus == 0 ? 1 : 0;
+        return true;
+    }
+
+    string_view lexeme(const LexToken& token) const { return string_view(begin + token.offset, token.length); }
+
+    // Bytes consumed so far
+    size_t offset() const { return pos - begin; }
+
+    // Bytes of the current block not consumed yet
+    size_t remaining() const { return end - pos; }
+
+    // Continues in the next block, which starts with the remaining() bytes
+    // of this one; tokens from this block are no longer valid
+    void resume(string_view block, bool isComplete) {
+        line += (uint32_t)count(lineCounted, pos, '\n');
+        begin = pos = lineCounted = block.data();
+        end = block.data() + block.size();
+        complete = isComplete;
+    }
+
+private:
+    const char* begin;
+    const char* pos;
+    const char* end;
+    bool complete;  // whether the input ends with this block
+    const char* lineCounted = begin;
+    uint32_t line = 1;
+    uint8_t quoteStatus = 0;  // 0 outside a string, 1 after the opening quote, 2 after the string body
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// --- Lock-free request metrics in Prometheus text format ---
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 64 us get exact buckets, above that every power of two is split into 32
+// linear sub-buckets, so any recorded value is off by at most ~3%. Buckets
+// are plain atomic counters; recording never takes a lock.
+class LatencyHistogram {
+    static const int SUB_BITS = 6;
+    static const uint64_t LINEAR = 1ull << SUB_BITS;       // exact below this
+    static const uint64_t HALF = LINEAR / 2;                // sub-buckets per power of two
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * HALF + HALF;
+
+    atomic<uint64_t> counts[BUCKETS];
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> sumMicros{0};
+
+    static size_t indexOf(uint64_t v) {
+        if (v < LINEAR) return (size_t)v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - (SUB_BITS - 1);
+        return (size_t)(shift * HALF + (v >> shift));
+    }
+
+    // Midpoint of a bucket, in microseconds
+    static double valueOf(size_t index) {
+        if (index < LINEAR) return (double)index;
+        int shift = (int)(index / HALF) - 1;
+        uint64_t mantissa = index - shift * HALF;
+        return (double)(mantissa << shift) + (double)(1ull << shift) / 2;
+    }
+
+public:
+    LatencyHistogram() {
+        for (auto& c : counts) c.store(0, memory_order_relaxed);
+    }
+
+    void record(uint64_t micros) {
+        counts[indexOf(micros)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sumMicros.fetch_add(micros, memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t sum() const { return sumMicros.load(memory_order_relaxed); }
+
+    // Value at quantile q (0..1) in microseconds; 0 when empty. Concurrent
+    // recording can make the result slightly stale, never invalid.
+    double quantile(double q) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = (uint64_t)(q * n);
+        if (rank >= n) rank = n - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen > rank) return valueOf(i);
+        }
+        return valueOf(BUCKETS - 1);
+    }
+};
+
+// Counters for one endpoint. The set of endpoints is fixed when the
+// registry is built, so lookups never modify shared structure.
+struct EndpointMetrics {
+    string name;
+    atomic<uint64_t> responses[5];  // by status class 1xx..5xx
+    atomic<uint64_t> bytesIn{0};
+    atomic<uint64_t> bytesOut{0};
+    atomic<int64_t> inFlight{0};
+    LatencyHistogram latency;
+
+    explicit EndpointMetrics(const string& n) : name(n) {
+        for (auto& r : responses) r.store(0, memory_order_relaxed);
+    }
+
+    void finish(int status, size_t in, size_t out, uint64_t micros) {
+        int cls = status / 100 - 1;
+        if (cls >= 0 && cls < 5) responses[cls].fetch_add(1, memory_order_relaxed);
+        bytesIn.fetch_add(in, memory_order_relaxed);
+        bytesOut.fetch_add(out, memory_order_relaxed);
+        latency.record(micros);
+    }
+};
+
+class MetricsRegistry {
+    vector<unique_ptr<EndpointMetrics>> endpoints;  // last one catches everything else
+    string prefix;
+
+    static void writeLabel(ostream& out, const EndpointMetrics& e) { out << "{endpoint=\"" << e.name << "\""; }
+
+public:
+    atomic<int64_t> openConnections{0};
+    atomic<uint64_t> rejectedRequests{0};  // could not be parsed or exceeded a limit
+    atomic<uint64_t> shedRequests{0};      // refused because the worker queue was full
+    atomic<uint64_t> overBudgetRequests{0};  // stopped for exceeding their time budget
+
+    MetricsRegistry(const string& metricPrefix, const vector<string>& names, const string& fallback)
+        : prefix(metricPrefix) {
+        for (const auto& n : names) endpoints.emplace_back(new EndpointMetrics(n));
+        endpoints.emplace_back(new EndpointMetrics(fallback));
+    }
+
+    EndpointMetrics& endpoint(const string& name) {
+        for (size_t i = 0; i + 1 < endpoints.size(); ++i) {
+            if (endpoints[i]->name == name) return *endpoints[i];
+        }
+        return *endpoints.back();
+    }
+
+    const string& metricPrefix() const { return prefix; }
+
+    void writePrometheus(ostream& out) const {
+        static const char* classes[5] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+        static const double quantiles[3] = {0.5, 0.99, 0.999};
+
+        out << "# HELP " << prefix << "requests_total Completed requests by endpoint and status class.\n";
+        out << "# TYPE " << prefix << "requests_total counter\n";
+        for (const auto& e : endpoints) {
+            for (int c = 0; c < 5; ++c) {
+                uint64_t n = e->responses[c].load(memory_order_relaxed);
+                if (n == 0 && c != 1) continue;
+                out << prefix << "requests_total";
+                writeLabel(out, *e);
+                out << ",code=\"" << classes[c] << "\"} " << n << "\n";
+            }
+        }
+
+        out << "# HELP " << prefix << "request_duration_seconds Time to produce the full response.\n";
+        out << "# TYPE " << prefix << "request_duration_seconds summary\n";
+        for (const auto& e : endpoints) {
+            for (double q : quantiles) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%g\"} %.6f\n", q, e->latency.quantile(q) / 1e6);
+                out << prefix << "request_duration_seconds";
+                writeLabel(out, *e);
+                out << ",quantile=\"" << buf;
+            }
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.6f", e->latency.sum() / 1e6);
+            out << prefix << "request_duration_seconds_sum";
+            writeLabel(out, *e);
+            out << "} " << buf << "\n";
+            out << prefix << "request_duration_seconds_count";
+            writeLabel(out, *e);
+            out << "} " << e->latency.count() << "\n";
+        }
+
+        out << "# HELP " << prefix << "request_bytes_total Bytes received in requests, headers included.\n";
+        out << "# TYPE " << prefix << "request_bytes_total counter\n";
+        for (const auto& e : endpoints) {
+            out << prefix << "request_bytes_total";
+            writeLabel(out, *e);
+            out << "} " << e->bytesIn.load(memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP " << prefix << "response_bytes_total Bytes sent in responses, headers included.\n";
+        out << "# TYPE " << prefix << "response_bytes_total counter\n";
+        for (const auto& e : endpoints) {
+            out << prefix << "response_bytes_total";
+            writeLabel(out, *e);
+            out << "} " << e->bytesOut.load(memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP " << prefix << "requests_in_flight Requests being processed.\n";
+        out << "# TYPE " << prefix << "requests_in_flight gauge\n";
+        for (const auto& e : endpoints) {
+            out << prefix << "requests_in_flight";
+            writeLabel(out, *e);
+            out << "} " << e->inFlight.load(memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP " << prefix << "open_connections Client connections currently open.\n";
+        out << "# TYPE " << prefix << "open_connections gauge\n";
+        out << prefix << "open_connections " << openConnections.load(memory_order_relaxed) << "\n";
+
+        out << "# HELP " << prefix << "rejected_requests_total Requests that were malformed or over a size limit.\n";
+        out << "# TYPE " << prefix << "rejected_requests_total counter\n";
+        out << prefix << "rejected_requests_total " << rejectedRequests.load(memory_order_relaxed) << "\n";
+
+        out << "# HELP " << prefix << "shed_requests_total Requests refused with 503 because the worker queue was full.\n";
+        out << "# TYPE " << prefix << "shed_requests_total counter\n";
+        out << prefix << "shed_requests_total " << shedRequests.load(memory_order_relaxed) << "\n";
+
+        out << "# HELP " << prefix << "over_budget_requests_total Requests stopped for exceeding their wall-clock or CPU budget.\n";
+        out << "# TYPE " << prefix << "over_budget_requests_total counter\n";
+        out << prefix << "over_budget_requests_total " << overBudgetRequests.load(memory_order_relaxed) << "\n";
+    }
+};
+
+// Wall-clock time spent in each stage of one request, for a Server-Timing
+// header (and optionally the response body). Stages with the same name
+// accumulate; they are listed in the order they first ran.
+class RequestTiming {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<pair<const char*, double>> phases;  // milliseconds
+
+    static string format(double ms) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", ms);
+        return buf;
+    }
+
+public:
+    void add(const char* name, double ms) {
+        for (auto& p : phases) {
+            if (strcmp(p.first, name) == 0) {
+                p.second += ms;
+                return;
+            }
+        }
+        phases.emplace_back(name, ms);
+    }
+
+    bool empty() const { return phases.empty(); }
+
+    double elapsedMs() const {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Value of a Server-Timing header, e.g. "decode;dur=0.012, parse;dur=1.500, total;dur=1.530"
+    string header() const {
+        string out;
+        for (const auto& p : phases) out += string(p.first) + ";dur=" + format(p.second) + ", ";
+        return out + "total;dur=" + format(elapsedMs());
+    }
+
+    // The same breakdown as a JSON object of milliseconds
+    string json() const {
+        string out = "{";
+        for (const auto& p : phases) out += "\"" + string(p.first) + "\":" + format(p.second) + ",";
+        return out + "\"total\":" + format(elapsedMs()) + "}";
+    }
+};
+
+// Timing of the request being handled on this thread, or null
+inline thread_local RequestTiming* currentTiming = nullptr;
+
+// Adds the lifetime of the object to a stage of the current request
+class PhaseTimer {
+    const char* name;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit PhaseTimer(const char* phase) : name(phase) {
+        if (currentTiming) start = chrono::steady_clock::now();
+    }
+    ~PhaseTimer() {
+        if (currentTiming) {
+            currentTiming->add(name, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef REQUEST_BUDGET_H
+#define REQUEST_BUDGET_H
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+// --- Per-request wall-clock and CPU budgets ---
+
+// Thrown out of an analysis that has used up its budget. The analyzers keep
+// no state across requests, so unwinding them is always safe.
+class BudgetExceeded : public runtime_error {
+public:
+    explicit BudgetExceeded(const string& what) : runtime_error(what) {}
+};
+
+// Deadlines for one request, checked cooperatively from the inner loops of
+// the lexer, the parsers and the translator. Reading the clocks costs far
+// more than one loop iteration, so only every CHECK_INTERVAL-th check does.
+class RequestBudget {
+    static const unsigned CHECK_INTERVAL = 128;
+
+    long wallLimitMs;
+    long cpuLimitMs;
+    chrono::steady_clock::time_point wallDeadline;
+    double cpuDeadline;  // seconds of thread CPU time
+    unsigned countdown = CHECK_INTERVAL;
+
+public:
+    // Seconds of CPU time used by the calling thread
+    static double threadCpuSeconds() {
+#ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+        ULARGE_INTEGER k, u;
+        k.LowPart = kernel.dwLowDateTime;
+        k.HighPart = kernel.dwHighDateTime;
+        u.LowPart = user.dwLowDateTime;
+        u.HighPart = user.dwHighDateTime;
+        return (double)(k.QuadPart + u.QuadPart) / 1e7;
+#else
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    }
+
+    // Limits in milliseconds; 0 means unlimited
+    RequestBudget(long wallMs, long cpuMs)
+        : wallLimitMs(wallMs), cpuLimitMs(cpuMs),
+          wallDeadline(chrono::steady_clock::now() + chrono::milliseconds(wallMs)),
+          cpuDeadline(cpuMs ? threadCpuSeconds() + cpuMs / 1000.0 : 0) {}
+
+    long wallLimit() const { return wallLimitMs; }
+    long cpuLimit() const { return cpuLimitMs; }
+
+    void check() {
+        if (--countdown) return;
+        countdown = CHECK_INTERVAL;
+        if (wallLimitMs && chrono::steady_clock::now() > wallDeadline) {
+            throw BudgetExceeded("Request exceeded its time limit of " + to_string(wallLimitMs) + " ms");
+        }
+        if (cpuLimitMs && threadCpuSeconds() > cpuDeadline) {
+            throw BudgetExceeded("Request exceeded its CPU limit of " + to_string(cpuLimitMs) + " ms");
+        }
+    }
+};
+
+// Budget of the request being handled on this thread, or null
+inline thread_local RequestBudget* currentBudget = nullptr;
+
+// Called once per iteration of every potentially long loop
+inline void checkBudget() {
+    if (currentBudget) currentBudget->check();
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+// --- Content-addressed cache of analysis results ---
+
+// A result is identified by the endpoint, the version of the grammar tables
+// it was computed with, and a 128-bit hash (plus length) of the decoded
+// source, so identical submissions hit regardless of how they were encoded.
+struct ResultKey {
+    string endpoint;
+    uint64_t version = 0;
+    uint64_t hashLow = 0;
+    uint64_t hashHigh = 0;
+    size_t length = 0;
+
+    bool operator==(const ResultKey& other) const {
+        return hashLow == other.hashLow && hashHigh == other.hashHigh && length == other.length &&
+               version == other.version && endpoint == other.endpoint;
+    }
+};
+
+struct ResultKeyHash {
+    size_t operator()(const ResultKey& key) const { return (size_t)(key.hashLow ^ (key.version * 0x9E3779B97F4A7C15ull)); }
+};
+
+inline uint64_t rotateLeft(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Final avalanche from MurmurHash3
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Two independent 64-bit lanes over 8-byte words
+inline void hashBytes(string_view s, uint64_t& low, uint64_t& high) {
+    uint64_t a = 0x9E3779B97F4A7C15ull ^ s.size();
+    uint64_t b = 0xC2B2AE3D27D4EB4Full + s.size();
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+        uint64_t w;
+        memcpy(&w, s.data() + i, 8);
+        a = rotateLeft(a ^ (w * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+        b = rotateLeft(b + (w * 0x4CF5AD432745937Full), 27) * 0x87C37B91114253D5ull + a;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, s.data() + i, s.size() - i);
+    a ^= tail * 0x87C37B91114253D5ull;
+    b += tail * 0x4CF5AD432745937Full;
+    low = mix64(a + b);
+    high = mix64(b ^ rotateLeft(a, 17));
+}
+
+// Thread-safe LRU cache bounded by bytes. Keys are spread over independently
+// locked shards, each evicting its own least recently used entries, so
+// concurrent lookups rarely contend. Values are shared and immutable: a
+// response can point straight at the cached bytes while they stay alive.
+class ResultCache {
+    typedef list<pair<ResultKey, shared_ptr<const string>>> LruList;
+
+    struct Shard {
+        mutex mtx;
+        LruList lru;  // most recently used first
+        unordered_map<ResultKey, LruList::iterator, ResultKeyHash> index;
+        size_t bytes = 0;
+    };
+
+    static const size_t SHARDS = 16;
+    static const size_t ENTRY_OVERHEAD = 128;  // list node, map node, key
+
+    Shard shards[SHARDS];
+    atomic<size_t> capacity{0};
+    atomic<uint64_t> hitCount{0};
+    atomic<uint64_t> missCount{0};
+    atomic<uint64_t> evictionCount{0};
+
+    static size_t entrySize(const ResultKey& key, const string& value) {
+        return value.size() + key.endpoint.size() + ENTRY_OVERHEAD;
+    }
+
+    Shard& shardFor(const ResultKey& key) { return shards[key.hashHigh % SHARDS]; }
+
+    void evict(Shard& shard, size_t limit) {
+        while (shard.bytes > limit && !shard.lru.empty()) {
+            auto& victim = shard.lru.back();
+            shard.bytes -= entrySize(victim.first, *victim.second);
+            shard.index.erase(victim.first);
+            shard.lru.pop_back();
+            evictionCount++;
+        }
+    }
+
+public:
+    struct Stats {
+        uint64_t hits, misses, evictions;
+        size_t entries, bytes, capacity;
+    };
+
+    static ResultKey makeKey(const string& endpoint, uint64_t version, string_view code) {
+        ResultKey key;
+        key.endpoint = endpoint;
+        key.version = version;
+        key.length = code.size();
+        hashBytes(code, key.hashLow, key.hashHigh);
+        return key;
+    }
+
+    // Total byte budget; 0 disables caching and drops everything
+    void setCapacity(size_t bytes) {
+        capacity = bytes;
+        for (auto& shard : shards) {
+            lock_guard<mutex> lock(shard.mtx);
+            evict(shard, bytes / SHARDS);
+        }
+    }
+
+    bool enabled() const { return capacity > 0; }
+
+    // Results larger than this are not worth caching: one would displace
+    // too much of its shard
+    size_t maxEntryBytes() const { return capacity / SHARDS / 4; }
+
+    shared_ptr<const string> get(const ResultKey& key) {
+        if (!enabled()) return nullptr;
+        Shard& shard = shardFor(key);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hitCount++;
+                return it->second->second;
+            }
+        }
+        missCount++;
+        return nullptr;
+    }
+
+    shared_ptr<const string> put(const ResultKey& key, string value) {
+        auto shared = make_shared<const string>(move(value));
+        if (!enabled() || shared->size() > maxEntryBytes()) return shared;
+        Shard& shard = shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {  // computed concurrently by another request
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return it->second->second;
+        }
+        shard.lru.emplace_front(key, shared);
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += entrySize(key, *shared);
+        evict(shard, capacity / SHARDS);
+        return shared;
+    }
+
+    Stats stats() {
+        Stats s{hitCount.load(), missCount.load(), evictionCount.load(), 0, 0, capacity.load()};
+        for (auto& shard : shards) {
+            lock_guard<mutex> lock(shard.mtx);
+            s.entries += shard.index.size();
+            s.bytes += shard.bytes;
+        }
+        return s;
+    }
+};
+
+// Passes output through to another stream while keeping a copy of up to
+// limit bytes, so a result that is streamed out can also be cached.
+class CapturingBuf : public streambuf {
+    streambuf* target;
+    string copy;
+    size_t limit;
+    bool overflowed = false;
+    char buffer[4096];
+
+    void forward() {
+        size_t len = pptr() - pbase();
+        if (!overflowed) {
+            if (copy.size() + len <= limit) copy.append(pbase(), len);
+            else {
+                overflowed = true;
+                string().swap(copy);
+            }
+        }
+        target->sputn(pbase(), len);
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        forward();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        forward();
+        return 0;
+    }
+
+public:
+    CapturingBuf(ostream& out, size_t maxBytes) : target(out.rdbuf()), limit(maxBytes) {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    // Flush what is buffered and hand over the copy; false if it exceeded the limit
+    bool take(string& out) {
+        forward();
+        if (overflowed) return false;
+        out = move(copy);
+        return true;
+    }
+};
+
+#endif
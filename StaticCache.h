@@ -0,0 +1,167 @@
+#ifndef STATIC_CACHE_H
+#define STATIC_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Deflate.h"
+
+using namespace std;
+
+// --- In-memory cache for the files under static/ ---
+
+// One cached file. Entries are immutable once published; a refresh swaps in
+// a new entry, so readers can keep using the one they looked up.
+// On Linux the identity body is not kept in memory: the entry holds an open
+// descriptor and responses sendfile() straight from the page cache. Editors
+// that save by rename leave this descriptor on the old, consistent inode.
+struct StaticAsset {
+    string body;     // identity body; empty on Linux, where fd is used instead
+    int fd = -1;
+    string gzip;     // empty when compression does not make it smaller
+    string deflate;
+    string etag;
+    string mime;
+    filesystem::file_time_type mtime;
+    uintmax_t size = 0;
+    mutable atomic<long long> checkedAt{0};  // last freshness check, steady-clock seconds
+
+    StaticAsset() = default;
+    StaticAsset(const StaticAsset&) = delete;
+    StaticAsset& operator=(const StaticAsset&) = delete;
+    ~StaticAsset() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+};
+
+class StaticAssetCache {
+    filesystem::path root;
+    function<string(const string&)> mimeOf;
+    unordered_map<string, shared_ptr<const StaticAsset>> assets;  // key: URL path, e.g. "/home.html"
+    mutable shared_mutex mtx;
+
+    static long long nowSeconds() {
+        return chrono::duration_cast<chrono::seconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // FNV-1a over the content; the size is appended to make collisions even less likely
+    static string makeETag(const string& body) {
+        uint64_t h = 1469598103934665603ull;
+        for (unsigned char ch : body) {
+            h ^= ch;
+            h *= 1099511628211ull;
+        }
+        char buf[48];
+        snprintf(buf, sizeof(buf), "\"%016llx-%zx\"", (unsigned long long)h, body.size());
+        return buf;
+    }
+
+    shared_ptr<const StaticAsset> load(const string& urlPath, const filesystem::path& file) const {
+        error_code ec;
+        auto mtime = filesystem::last_write_time(file, ec);
+        if (ec || !filesystem::is_regular_file(file, ec)) return nullptr;
+
+        auto asset = make_shared<StaticAsset>();
+#ifdef __linux__
+        asset->fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (asset->fd < 0) return nullptr;
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(asset->fd, buf, sizeof(buf))) > 0) asset->body.append(buf, n);
+        if (n < 0) return nullptr;
+#else
+        ifstream in(file, ios::binary);
+        if (!in) return nullptr;
+        asset->body.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+#endif
+        asset->mtime = mtime;
+        asset->size = asset->body.size();
+        asset->etag = makeETag(asset->body);
+        asset->mime = mimeOf(urlPath);
+        string gz = gzipCompress(asset->body);
+        if (gz.size() < asset->body.size()) {
+            asset->gzip = move(gz);
+            asset->deflate = zlibCompress(asset->body);
+        }
+#ifdef __linux__
+        string().swap(asset->body);
+#endif
+        asset->checkedAt = nowSeconds();
+        return asset;
+    }
+
+    // Reject anything that could escape the static root
+    static bool safePath(const string& urlPath) {
+        return !urlPath.empty() && urlPath[0] == '/' && urlPath.find("..") == string::npos &&
+               urlPath.find('\\') == string::npos && urlPath.find('\0') == string::npos;
+    }
+
+public:
+    StaticAssetCache(const string& dir, function<string(const string&)> mime)
+        : root(dir), mimeOf(move(mime)) {}
+
+    // Load every file under the root up front
+    size_t preload() {
+        error_code ec;
+        size_t count = 0;
+        for (auto it = filesystem::recursive_directory_iterator(root, ec);
+             !ec && it != filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file()) continue;
+            string urlPath = "/" + filesystem::relative(it->path(), root).generic_string();
+            auto asset = load(urlPath, it->path());
+            if (!asset) continue;
+            unique_lock<shared_mutex> lock(mtx);
+            assets[urlPath] = asset;
+            ++count;
+        }
+        return count;
+    }
+
+    // Look up a file; at most once per second per entry its mtime/size is
+    // compared with the disk and the entry reloaded if it changed.
+    shared_ptr<const StaticAsset> get(const string& urlPath) {
+        if (!safePath(urlPath)) return nullptr;
+        shared_ptr<const StaticAsset> asset;
+        {
+            shared_lock<shared_mutex> lock(mtx);
+            auto it = assets.find(urlPath);
+            if (it != assets.end()) asset = it->second;
+        }
+
+        filesystem::path file = root / urlPath.substr(1);
+        long long now = nowSeconds();
+        if (asset) {
+            long long last = asset->checkedAt.load();
+            if (now == last || !asset->checkedAt.compare_exchange_strong(last, now)) return asset;
+            error_code ec;
+            auto mtime = filesystem::last_write_time(file, ec);
+            uintmax_t size = ec ? 0 : filesystem::file_size(file, ec);
+            if (!ec && mtime == asset->mtime && size == asset->size) return asset;
+        }
+
+        // Missing, changed on disk, or deleted
+        auto fresh = load(urlPath, file);
+        unique_lock<shared_mutex> lock(mtx);
+        if (fresh) assets[urlPath] = fresh;
+        else assets.erase(urlPath);
+        return fresh;
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// --- Fixed-size worker pool ---
+
+// Workers pull tasks from a shared FIFO queue. The acceptor only enqueues,
+// so one slow request never blocks accepting or serving other connections.
+// With a queue limit, trySubmit() refuses work instead of letting the queue
+// (and with it the latency of everything queued) grow without bound.
+class ThreadPool {
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex mtx;
+    condition_variable cv;
+    bool stopping = false;
+    size_t maxQueued;  // 0 = unbounded
+    function<void()> onStart;
+
+    void workerLoop() {
+        if (onStart) onStart();
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    // onStart runs first on every worker thread, e.g. to pin it to a CPU
+    explicit ThreadPool(size_t threadCount, size_t queueLimit = 0, function<void()> startHook = nullptr)
+        : maxQueued(queueLimit), onStart(move(startHook)) {
+        if (threadCount == 0) threadCount = 1;
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> lock(mtx);
+            tasks.push(move(task));
+        }
+        cv.notify_one();
+    }
+
+    // Enqueue unless the queue limit has been reached
+    bool trySubmit(function<void()> task) {
+        {
+            lock_guard<mutex> lock(mtx);
+            if (maxQueued && tasks.size() >= maxQueued) return false;
+            tasks.push(move(task));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // Tasks waiting for a worker
+    size_t queued() {
+        lock_guard<mutex> lock(mtx);
+        return tasks.size();
+    }
+
+    size_t size() const { return workers.size(); }
+};
+
+#endif
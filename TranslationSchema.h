@@ -7,6 +7,7 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include "InputSource.h"
 using namespace std;
 
 vector<string> split(string const& s) {
@@ -340,7 +341,7 @@ void read_prog(string& prog)
 void Analysis()
 {
     string prog;
-    read_prog(prog);
+    readAllInput(prog);  // 整块读入，代替read_prog逐字节scanf
     /* 骚年们 请开始你们的表演 */
     /********* Begin *********/
     Translator t(prog);
@@ -0,0 +1,73 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// --- UTF-8 validation ---
+
+// Length of the well-formed UTF-8 sequence starting at s[i], or 0 if there
+// is none (stray continuation bytes, overlong forms, surrogates, values
+// past U+10FFFF, truncation)
+inline size_t utf8SequenceLength(string_view s, size_t i) {
+    unsigned char c = s[i];
+    if (c < 0x80) return 1;
+    int extra;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0) { extra = 1; cp = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { extra = 2; cp = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { extra = 3; cp = c & 0x07; }
+    else return 0;
+    if (i + extra >= s.size()) return 0;
+    for (int k = 1; k <= extra; ++k) {
+        unsigned char cc = s[i + k];
+        if ((cc & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    static const uint32_t minimum[4] = {0, 0x80, 0x800, 0x10000};
+    if (cp < minimum[extra] || (cp >= 0xD800 && cp < 0xE000) || cp > 0x10FFFF) return 0;
+    return extra + 1;
+}
+
+inline bool validUtf8(string_view s) {
+    for (size_t i = 0; i < s.size();) {
+        size_t n = utf8SequenceLength(s, i);
+        if (n == 0) return false;
+        i += n;
+    }
+    return true;
+}
+
+// Replace each ill-formed byte with U+FFFD, for outputs that must be UTF-8
+inline string toValidUtf8(string_view s) {
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size();) {
+        size_t n = utf8SequenceLength(s, i);
+        if (n == 0) {
+            out += "\xEF\xBF\xBD";
+            ++i;
+        } else {
+            out.append(s.data() + i, n);
+            i += n;
+        }
+    }
+    return out;
+}
+
+// Bytes at the end of s that begin a UTF-8 sequence but stop short of its
+// end, so a writer cutting text into pieces can carry them to the next one
+inline size_t incompleteUtf8Tail(string_view s) {
+    for (size_t k = 1; k <= 3 && k <= s.size(); ++k) {
+        unsigned char c = s[s.size() - k];
+        if ((c & 0xC0) == 0x80) continue;
+        size_t length = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+        return length > k ? k : 0;
+    }
+    return 0;
+}
+
+#endif
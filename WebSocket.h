@@ -0,0 +1,273 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "Utf8.h"
+
+using namespace std;
+
+// --- WebSocket protocol (RFC 6455): opening handshake and framing ---
+
+// SHA-1 (FIPS 180-4), needed only for the handshake's Sec-WebSocket-Accept
+inline string sha1Digest(string_view data) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+
+    string msg(data);
+    uint64_t bitLength = (uint64_t)data.size() * 8;
+    msg += (char)0x80;
+    while (msg.size() % 64 != 56) msg += (char)0;
+    for (int i = 7; i >= 0; --i) msg += (char)(bitLength >> (i * 8));
+
+    for (size_t block = 0; block < msg.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char* p = (const unsigned char*)msg.data() + block + i * 4;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    string digest(20, '\0');
+    for (int i = 0; i < 20; ++i) digest[i] = (char)(h[i / 4] >> (24 - (i % 4) * 8));
+    return digest;
+}
+
+inline string base64Encode(string_view data) {
+    static const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        uint32_t v = (unsigned char)data[i] << 16 | (unsigned char)data[i + 1] << 8 | (unsigned char)data[i + 2];
+        out += table[v >> 18];
+        out += table[(v >> 12) & 63];
+        out += table[(v >> 6) & 63];
+        out += table[v & 63];
+    }
+    if (i < data.size()) {
+        uint32_t v = (unsigned char)data[i] << 16;
+        if (i + 1 < data.size()) v |= (unsigned char)data[i + 1] << 8;
+        out += table[v >> 18];
+        out += table[(v >> 12) & 63];
+        out += i + 1 < data.size() ? table[(v >> 6) & 63] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+// Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+inline string webSocketAccept(const string& key) {
+    return base64Encode(sha1Digest(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+enum WsOpcode { WS_CONTINUATION = 0x0, WS_TEXT = 0x1, WS_BINARY = 0x2, WS_CLOSE = 0x8, WS_PING = 0x9, WS_PONG = 0xA };
+
+// Close status codes (RFC 6455, 7.4.1)
+enum WsCloseCode { WS_NORMAL = 1000, WS_GOING_AWAY = 1001, WS_PROTOCOL_ERROR = 1002, WS_UNSUPPORTED_DATA = 1003,
+                   WS_INVALID_DATA = 1007, WS_TOO_BIG = 1009 };
+
+// Header of an unfragmented, unmasked (server-to-client) frame
+inline string webSocketFrameHeader(WsOpcode opcode, size_t payloadLength) {
+    string header;
+    header += (char)(0x80 | opcode);
+    if (payloadLength < 126) {
+        header += (char)payloadLength;
+    } else if (payloadLength <= 0xFFFF) {
+        header += (char)126;
+        header += (char)(payloadLength >> 8);
+        header += (char)(payloadLength & 0xFF);
+    } else {
+        header += (char)127;
+        for (int i = 7; i >= 0; --i) header += (char)((uint64_t)payloadLength >> (i * 8));
+    }
+    return header;
+}
+
+inline string webSocketFrame(WsOpcode opcode, string_view payload) {
+    return webSocketFrameHeader(opcode, payload.size()) + string(payload);
+}
+
+inline string webSocketCloseFrame(uint16_t code, const string& reason = "") {
+    string payload;
+    payload += (char)(code >> 8);
+    payload += (char)(code & 0xFF);
+    payload += reason.substr(0, 123);
+    return webSocketFrame(WS_CLOSE, payload);
+}
+
+// Incremental parser for client-to-server frames, shaped like
+// HttpRequestParser: bytes are fed as they arrive and feed() stops once a
+// message is complete, leaving the rest for the next one. Fragmented data
+// messages are reassembled; control frames may arrive between fragments
+// and are reported on their own. Payloads are unmasked in place.
+class WebSocketParser {
+public:
+    enum Status { NeedMore, Complete, Failed };
+
+private:
+    enum State { Header, Payload, Done, Error };
+
+    size_t maxMessageBytes;
+    State state = Header;
+    unsigned char header[14];
+    size_t headerHave = 0;
+    bool fin = false;
+    int opcode = 0;
+    unsigned char mask[4];
+    uint64_t remaining = 0;
+    size_t maskOffset = 0;
+    int messageOpcode = -1;  // opcode of the data message being reassembled
+    string message;          // data message being reassembled
+    string control;          // payload of the current control frame
+    int doneOpcode = 0;
+    string donePayload;
+    uint16_t errorCode = 0;
+    string errorText;
+
+    void fail(uint16_t code, const string& text) {
+        state = Error;
+        errorCode = code;
+        errorText = text;
+    }
+
+    static size_t headerLength(const unsigned char* h, size_t have) {
+        if (have < 2) return 2;
+        size_t len = (h[1] & 0x80) ? 2 + 4 : 2;  // unmasked frames are rejected once the first two bytes are in
+        if ((h[1] & 0x7F) == 126) len += 2;
+        else if ((h[1] & 0x7F) == 127) len += 8;
+        return len;
+    }
+
+    // A complete header is buffered: validate it and set up the payload
+    void beginFrame() {
+        fin = header[0] & 0x80;
+        opcode = header[0] & 0x0F;
+        if (header[0] & 0x70) return fail(WS_PROTOCOL_ERROR, "Reserved bits set");
+        if (!(header[1] & 0x80)) return fail(WS_PROTOCOL_ERROR, "Client frames must be masked");
+        size_t at = 2;
+        uint64_t length = header[1] & 0x7F;
+        if (length == 126) {
+            length = (uint64_t)header[2] << 8 | header[3];
+            at = 4;
+        } else if (length == 127) {
+            length = 0;
+            for (int i = 0; i < 8; ++i) length = length << 8 | header[2 + i];
+            at = 10;
+        }
+        memcpy(mask, header + at, 4);
+        maskOffset = 0;
+        remaining = length;
+
+        bool isControl = opcode & 0x8;
+        if (isControl) {
+            if (opcode != WS_CLOSE && opcode != WS_PING && opcode != WS_PONG) return fail(WS_PROTOCOL_ERROR, "Unknown opcode");
+            if (!fin || length > 125) return fail(WS_PROTOCOL_ERROR, "Invalid control frame");
+            control.clear();
+        } else if (opcode == WS_CONTINUATION) {
+            if (messageOpcode < 0) return fail(WS_PROTOCOL_ERROR, "Unexpected continuation frame");
+        } else if (opcode == WS_TEXT || opcode == WS_BINARY) {
+            if (messageOpcode >= 0) return fail(WS_PROTOCOL_ERROR, "Expected a continuation frame");
+            messageOpcode = opcode;
+            message.clear();
+        } else {
+            return fail(WS_PROTOCOL_ERROR, "Unknown opcode");
+        }
+        if (!isControl && message.size() + length > maxMessageBytes) {
+            return fail(WS_TOO_BIG, "Message exceeds " + to_string(maxMessageBytes) + " bytes");
+        }
+        if (!isControl) message.reserve(message.size() + length);
+        state = Payload;
+        if (remaining == 0) endFrame();
+    }
+
+    void endFrame() {
+        headerHave = 0;
+        if (opcode & 0x8) {
+            doneOpcode = opcode;
+            donePayload = move(control);
+            control.clear();
+            state = Done;
+            return;
+        }
+        if (!fin) {
+            state = Header;
+            return;
+        }
+        if (messageOpcode == WS_TEXT && !validUtf8(message)) return fail(WS_INVALID_DATA, "Text is not valid UTF-8");
+        doneOpcode = messageOpcode;
+        donePayload = move(message);
+        message.clear();
+        messageOpcode = -1;
+        state = Done;
+    }
+
+public:
+    explicit WebSocketParser(size_t maxMessage) : maxMessageBytes(maxMessage) {}
+
+    // Consume bytes until a message is complete or input runs out.
+    // Returns how many bytes were used.
+    size_t feed(const char* data, size_t len) {
+        size_t used = 0;
+        while (used < len && (state == Header || state == Payload)) {
+            if (state == Header) {
+                size_t need = headerLength(header, headerHave);
+                while (headerHave < need && used < len) {
+                    header[headerHave++] = data[used++];
+                    need = headerLength(header, headerHave);
+                }
+                if (headerHave == need) beginFrame();
+                continue;
+            }
+            size_t take = (size_t)min<uint64_t>(remaining, len - used);
+            string& target = (opcode & 0x8) ? control : message;
+            size_t start = target.size();
+            target.append(data + used, take);
+            for (size_t i = 0; i < take; ++i) target[start + i] ^= mask[(maskOffset + i) & 3];
+            maskOffset += take;
+            used += take;
+            remaining -= take;
+            if (remaining == 0) endFrame();
+        }
+        return used;
+    }
+
+    Status status() const {
+        if (state == Done) return Complete;
+        if (state == Error) return Failed;
+        return NeedMore;
+    }
+
+    uint16_t errorStatus() const { return errorCode; }
+    const string& errorMessage() const { return errorText; }
+
+    // Hand over the finished message (or control frame) and continue
+    int take(string& payload) {
+        payload = move(donePayload);
+        donePayload.clear();
+        state = Header;
+        return doneOpcode;
+    }
+};
+
+#endif
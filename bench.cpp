@@ -0,0 +1,434 @@
+// 回环压测工具：对本机的服务器并发发起请求，统计各接口的吞吐量与延迟分位数，结果以JSON输出，
+// 便于在同一台机器上比较服务器改动前后的表现。
+// 编译：g++ -std=c++17 -O2 -pthread -o bench bench.cpp（Windows 下另需链接 ws2_32）
+// 用法：./bench --port=8080 --connections=16 --duration=10 --warmup=1
+//              --endpoints=analyze,llparse,lrparse,translate,static --payload-bytes=2048
+//              --keepalive=1 --vary=0 --static-path=/style.css
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+struct BenchConfig {
+    string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;         // 并发连接数，每个连接一个线程，收到响应后立即发下一个请求
+    double duration = 10;        // 计入统计的秒数
+    double warmup = 1;           // 开始统计前的预热秒数
+    vector<string> endpoints = {"analyze", "llparse", "lrparse", "translate", "static"};
+    size_t payloadBytes = 2048;  // 分析接口请求中源程序的大致长度
+    bool keepAlive = true;       // false 时每个请求新建连接
+    bool vary = false;           // true 时每个请求的程序都不同，避开服务器的结果缓存
+    string staticPath = "/style.css";
+    int timeoutSeconds = 30;     // 单个请求的收发超时
+};
+
+// 语法分析接口（LL/LR文法）的程序：赋值、if、while语句循环填充到指定长度
+string parserProgram(size_t bytes, uint64_t seq) {
+    string code = "{\nv = " + to_string(seq) + " ;\n";
+    for (int i = 0; code.size() < bytes; ++i) {
+        string n = to_string(i);
+        switch (i % 3) {
+            case 0: code += "a = b + " + n + " * ( c - 1 ) ;\n"; break;
+            case 1: code += "if ( a > " + n + " ) then b = a / 2 ; else b = a - 1 ;\n"; break;
+            default: code += "while ( a <= b ) a = a + " + n + " ;\n"; break;
+        }
+    }
+    return code + "}\n";
+}
+
+// 翻译接口的程序：先声明变量，再执行一串不含循环的语句
+string translationProgram(size_t bytes, uint64_t seq) {
+    string code = "int a = " + to_string(seq % 1000) + " ;\nint b = 2 ;\nreal c = 3.5 ;\n{\n";
+    for (int i = 0; code.size() < bytes; ++i) {
+        string n = to_string(i % 100);
+        if (i % 2 == 0) code += "a = b + " + n + " ;\n";
+        else code += "if ( a > b ) then c = c + " + n + " ; else c = c - 1 ;\n";
+    }
+    return code + "b = a * 3 ;\n}\n";
+}
+
+// 词法分析接口的程序：带注释、字符串和各种运算符的C代码
+string lexerProgram(size_t bytes, uint64_t seq) {
+    string code = "// request " + to_string(seq) + "\n";
+    for (int i = 0; code.size() < bytes; ++i) {
+        string n = to_string(i);
+        code += "int x" + n + " = " + n + " * 3.5; /* block */ if (x" + n + " >= 2 && x" + n +
+                " != 7) { x" + n + " -= 1; printf(\"v=%d\\n\", x" + n + "); } // line\n";
+    }
+    return code;
+}
+
+string jsonString(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c; break;
+        }
+    }
+    return out + "\"";
+}
+
+// 一个被压测的接口：请求由 build 按序号生成（不区分请求时只生成一次）
+struct Target {
+    string name;
+    string (*program)(size_t, uint64_t) = nullptr;  // 空表示静态文件
+};
+
+string buildRequest(const Target& target, const BenchConfig& config, uint64_t seq) {
+    string connection = config.keepAlive ? "keep-alive" : "close";
+    if (!target.program) {
+        return "GET " + config.staticPath + " HTTP/1.1\r\nHost: " + config.host + "\r\nConnection: " + connection +
+               "\r\n\r\n";
+    }
+    string body = "{\"code\":" + jsonString(target.program(config.payloadBytes, seq)) + "}";
+    return "POST /" + target.name + " HTTP/1.1\r\nHost: " + config.host + "\r\nConnection: " + connection +
+           "\r\nContent-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+// 客户端连接：发送请求并完整读出一个响应（Content-Length、分块编码或读到连接关闭）
+class Client {
+    const BenchConfig& config;
+    int fd = -1;
+    string in;  // 已收到、尚未解析的字节
+
+    bool fill() {
+        char buffer[65536];
+        int n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return false;
+        in.append(buffer, n);
+        return true;
+    }
+
+    // 读到 in 中至少有 n 个字节
+    bool need(size_t n) {
+        while (in.size() < n) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    // 读出一行（不含\r\n）
+    bool line(string& out) {
+        size_t end;
+        while ((end = in.find("\r\n")) == string::npos) {
+            if (!fill()) return false;
+        }
+        out = in.substr(0, end);
+        in.erase(0, end + 2);
+        return true;
+    }
+
+    bool readChunked(size_t& bodyBytes) {
+        while (true) {
+            string sizeLine;
+            if (!line(sizeLine)) return false;
+            size_t size = strtoul(sizeLine.c_str(), nullptr, 16);
+            if (size == 0) {
+                string trailer;
+                do {
+                    if (!line(trailer)) return false;
+                } while (!trailer.empty());
+                return true;
+            }
+            if (!need(size + 2)) return false;
+            in.erase(0, size + 2);
+            bodyBytes += size;
+        }
+    }
+
+public:
+    explicit Client(const BenchConfig& c) : config(c) {}
+    ~Client() { disconnect(); }
+
+    bool connected() const { return fd >= 0; }
+
+    bool connect() {
+        fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+#ifdef _WIN32
+        DWORD timeout = config.timeoutSeconds * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (char*)&timeout, sizeof(timeout));
+#else
+        timeval timeout{config.timeoutSeconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#endif
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(config.port);
+        inet_pton(AF_INET, config.host.c_str(), &address.sin_addr);
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) closeSocket(fd);
+        fd = -1;
+        in.clear();
+    }
+
+    // 返回状态码，失败返回-1；响应要求关闭连接时随后断开
+    int roundTrip(const string& request, size_t& bodyBytes) {
+        for (size_t sent = 0; sent < request.size();) {
+            int n = send(fd, request.data() + sent, (int)(request.size() - sent), 0);
+            if (n <= 0) return -1;
+            sent += n;
+        }
+        string statusLine, header;
+        if (!line(statusLine) || statusLine.size() < 12) return -1;
+        int status = atoi(statusLine.c_str() + 9);
+        long long length = -1;
+        bool chunked = false, closing = statusLine.compare(0, 8, "HTTP/1.0") == 0;
+        while (true) {
+            if (!line(header)) return -1;
+            if (header.empty()) break;
+            string name = header.substr(0, header.find(':'));
+            for (auto& ch : name) ch = tolower((unsigned char)ch);
+            string value = header.substr(min(header.size(), name.size() + 1));
+            value.erase(0, value.find_first_not_of(" \t"));
+            if (name == "content-length") length = atoll(value.c_str());
+            else if (name == "transfer-encoding") chunked = value.find("chunked") != string::npos;
+            else if (name == "connection") closing = value.find("close") != string::npos;
+        }
+        bodyBytes = 0;
+        if (status == 101 || status == 204 || status == 304) {
+        } else if (chunked) {
+            if (!readChunked(bodyBytes)) return -1;
+        } else if (length >= 0) {
+            if (!need((size_t)length)) return -1;
+            in.erase(0, (size_t)length);
+            bodyBytes = (size_t)length;
+        } else {
+            while (fill()) {}
+            bodyBytes = in.size();
+            closing = true;
+        }
+        if (closing) disconnect();
+        return status;
+    }
+};
+
+// 一个接口在一个线程中的统计
+struct EndpointStats {
+    vector<uint32_t> latencyUs;
+    uint64_t errors = 0;      // 连接失败、超时或响应不完整
+    uint64_t non2xx = 0;
+    uint64_t bodyBytes = 0;
+
+    void merge(const EndpointStats& other) {
+        latencyUs.insert(latencyUs.end(), other.latencyUs.begin(), other.latencyUs.end());
+        errors += other.errors;
+        non2xx += other.non2xx;
+        bodyBytes += other.bodyBytes;
+    }
+};
+
+// 单个连接的请求循环：按接口轮流发请求，预热结束后才开始计数
+void runConnection(int index, const BenchConfig& config, const vector<Target>& targets,
+                   const vector<string>& fixedRequests, chrono::steady_clock::time_point measureStart,
+                   chrono::steady_clock::time_point end, atomic<uint64_t>& sequence, vector<EndpointStats>& stats) {
+    Client client(config);
+    size_t next = index % targets.size();
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        if (start >= end) break;
+        const Target& target = targets[next];
+        EndpointStats& s = stats[next];
+        next = (next + 1) % targets.size();
+
+        string varied;
+        if (config.vary && target.program) varied = buildRequest(target, config, sequence++);
+        const string& request = varied.empty() ? fixedRequests[&target - &targets[0]] : varied;
+
+        size_t bodyBytes = 0;
+        int status = -1;
+        if (client.connected() || client.connect()) status = client.roundTrip(request, bodyBytes);
+        if (status < 0) client.disconnect();
+        if (!config.keepAlive) client.disconnect();
+
+        auto finish = chrono::steady_clock::now();
+        if (start < measureStart) continue;
+        if (finish > end) break;  // 跨过统计窗口结束的请求不计入
+        if (status < 0) {
+            s.errors++;
+            this_thread::sleep_for(chrono::milliseconds(10));  // 服务器不可用时不空转
+            continue;
+        }
+        if (status < 200 || status >= 300) s.non2xx++;
+        s.bodyBytes += bodyBytes;
+        s.latencyUs.push_back((uint32_t)chrono::duration_cast<chrono::microseconds>(finish - start).count());
+    }
+}
+
+// 最近秩法的分位数（毫秒）
+double percentileMs(const vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    rank = min(max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1] / 1000.0;
+}
+
+string statsJSON(EndpointStats& s, double seconds) {
+    sort(s.latencyUs.begin(), s.latencyUs.end());
+    double sum = 0;
+    for (uint32_t v : s.latencyUs) sum += v;
+    size_t count = s.latencyUs.size();
+    ostringstream json;
+    json.setf(ios::fixed);
+    json.precision(3);
+    json << "{\"requests\":" << count << ",\"errors\":" << s.errors << ",\"non2xx\":" << s.non2xx
+         << ",\"requestsPerSecond\":" << count / seconds << ",\"bodyBytesPerSecond\":" << s.bodyBytes / seconds
+         << ",\"latencyMs\":{\"mean\":" << (count ? sum / count / 1000.0 : 0.0)
+         << ",\"p50\":" << percentileMs(s.latencyUs, 50) << ",\"p90\":" << percentileMs(s.latencyUs, 90)
+         << ",\"p99\":" << percentileMs(s.latencyUs, 99) << ",\"p99.9\":" << percentileMs(s.latencyUs, 99.9)
+         << ",\"max\":" << (count ? s.latencyUs.back() / 1000.0 : 0.0) << "}}";
+    return json.str();
+}
+
+vector<string> splitList(const string& s) {
+    vector<string> items;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// 解析命令行参数，格式与服务器相同：--名称=值
+bool parseArgs(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--host") config.host = value;
+        else if (key == "--port") config.port = atoi(value.c_str());
+        else if (key == "--connections") config.connections = max(1, atoi(value.c_str()));
+        else if (key == "--duration") config.duration = max(0.1, atof(value.c_str()));
+        else if (key == "--warmup") config.warmup = max(0.0, atof(value.c_str()));
+        else if (key == "--endpoints") config.endpoints = splitList(value);
+        else if (key == "--payload-bytes") config.payloadBytes = (size_t)max(0LL, atoll(value.c_str()));
+        else if (key == "--keepalive") config.keepAlive = value != "0" && value != "false";
+        else if (key == "--vary") config.vary = value != "0" && value != "false";
+        else if (key == "--static-path") config.staticPath = value;
+        else if (key == "--timeout") config.timeoutSeconds = max(1, atoi(value.c_str()));
+        else {
+            cerr << "未知参数: " << arg << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) return 2;
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    static const map<string, string (*)(size_t, uint64_t)> programs = {
+        {"analyze", lexerProgram},
+        {"llparse", parserProgram},
+        {"lrparse", parserProgram},
+        {"translate", translationProgram},
+        {"static", nullptr},
+    };
+    vector<Target> targets;
+    for (const string& name : config.endpoints) {
+        auto it = programs.find(name);
+        if (it == programs.end()) {
+            cerr << "未知接口: " << name << endl;
+            return 2;
+        }
+        targets.push_back({name, it->second});
+    }
+    if (targets.empty()) {
+        cerr << "没有要压测的接口" << endl;
+        return 2;
+    }
+    vector<string> fixedRequests;
+    for (const Target& target : targets) fixedRequests.push_back(buildRequest(target, config, 0));
+
+    auto start = chrono::steady_clock::now();
+    auto measureStart = start + chrono::microseconds((long long)(config.warmup * 1e6));
+    auto end = measureStart + chrono::microseconds((long long)(config.duration * 1e6));
+    atomic<uint64_t> sequence(1);
+    vector<vector<EndpointStats>> perThread(config.connections, vector<EndpointStats>(targets.size()));
+    vector<thread> threads;
+    for (int i = 0; i < config.connections; ++i) {
+        threads.emplace_back(runConnection, i, cref(config), cref(targets), cref(fixedRequests), measureStart, end,
+                             ref(sequence), ref(perThread[i]));
+    }
+    for (auto& t : threads) t.join();
+
+    EndpointStats total;
+    vector<EndpointStats> merged(targets.size());
+    for (auto& stats : perThread) {
+        for (size_t i = 0; i < targets.size(); ++i) merged[i].merge(stats[i]);
+    }
+    for (auto& s : merged) total.merge(s);
+
+    ostringstream json;
+    json << "{\"config\":{\"host\":" << jsonString(config.host) << ",\"port\":" << config.port
+         << ",\"connections\":" << config.connections << ",\"duration\":" << config.duration
+         << ",\"warmup\":" << config.warmup << ",\"payloadBytes\":" << config.payloadBytes
+         << ",\"keepAlive\":" << (config.keepAlive ? "true" : "false") << ",\"vary\":" << (config.vary ? "true" : "false")
+         << ",\"endpoints\":[";
+    for (size_t i = 0; i < targets.size(); ++i) json << (i ? "," : "") << jsonString(targets[i].name);
+    json << "]},\"total\":" << statsJSON(total, config.duration) << ",\"endpoints\":{";
+    for (size_t i = 0; i < targets.size(); ++i) {
+        json << (i ? "," : "") << jsonString(targets[i].name) << ":" << statsJSON(merged[i], config.duration);
+    }
+    json << "}}";
+    cout << json.str() << endl;
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return total.latencyUs.empty() ? 1 : 0;
+}
@@ -10,6 +10,17 @@
 #include <vector>
 #include <algorithm>
 #include <streambuf>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <cerrno>
+#include <ctime>
+#include <chrono>
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
@@ -22,393 +33,169 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
 #endif
 
 #include "LR parser.h"
 #include "TableGenerator.h"
+#include "ThreadPool.h"
+#include "StaticCache.h"
+#include "JsonDecoder.h"
+#include "HttpParser.h"
+#include "ChunkedStream.h"
+#include "ResultCache.h"
+#include "Metrics.h"
+#include "RequestBudget.h"
+#include "WebSocket.h"
+#include "CborWriter.h"
+#include "IoUring.h"
+#include "Coroutine.h"
+#include "LexerDFA.h"
 
 using namespace std;
 
-// 枚举token存在的类型
-unordered_map<string, short> typeNameMap = {
-    {"auto",1}, {"break",2}, {"case",3}, {"char",4}, {"const",5},
-    {"continue",6}, {"default",7}, {"do",8}, {"double",9}, {"else",10},
-    {"enum",11}, {"extern",12}, {"float",13}, {"for",14}, {"goto",15},
-    {"if",16}, {"int",17}, {"long",18}, {"register",19}, {"return",20},
-    {"short",21}, {"signed",22}, {"sizeof",23}, {"static",24}, {"struct",25},
-    {"switch",26}, {"typedef",27}, {"union",28}, {"unsigned",29}, {"void",30},
-    {"volatile",31}, {"while",32}, {"-",33}, {"--",34}, {"-=",35},
-    {"->",36}, {"!",37}, {"!=",38}, {"%",39}, {"%=",40},
-    {"&",41}, {"&&",42}, {"&=",43}, {"(",44}, {")",45},
-    {"*",46}, {"*=",47}, {",",48}, {".",49}, {"/",50},
-    {"/=",51}, {":",52}, {";",53}, {"?",54}, {"[",55},
-    {"]",56}, {"^",57}, {"^=",58}, {"{",59}, {"|",60},
-    {"||",61}, {"|=",62}, {"}",63}, {"~",64}, {"+",65},
-    {"++",66}, {"+=",67}, {"<",68}, {"<<",69}, {"<<=",70},
-    {"<=",71}, {"=",72}, {"==",73}, {">",74}, {">=",75},
-    {">>",76}, {">>=",77}, {"\"",78}, {"Comment",79}, {"Constant",80},
-    {"Identifier",81}
-};
-
-// 关键字数组
-vector<string> Keywords = {
-    "auto", "break", "case", "char", "const", "continue", "default", "do", 
-    "double", "else", "enum", "extern", "float", "for", "goto", "if", "int", 
-    "long", "register", "return", "short", "signed", "sizeof", "static", 
-    "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while"
-};
-
-// 字符类型枚举
-enum CharType {
-    Alphabet, Number, Symbol, Slash, Blank, Quote, Endl, Star, Dot, Eof
-};
-
-// Token数据结构
-struct TokenInfo {
-    int id;
-    string lexeme;
-    string typeName;
-    int typeId;
-};
-
-// 全局变量
-string src;
-int pos = 0;
-int tokenCount = 0;
-short quoteStatus = 0;
-
-// 查看下一个字符的类型 
-CharType peekChar() {
-    if (pos >= src.length()) return Eof;
-    char ch = src[pos];
-    if ((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '_') return Alphabet;
-    if (ch >= '0' && ch <= '9') return Number;
-    switch (ch) {
-        case ' ': case '\t': return Blank;
-        case '\n': return Endl;
-        case '.': return Dot;
-        case '*': return Star;
-        case '/': return Slash;
-        case '"': return Quote;
-        default: return Symbol;
-    }
-}
-
-// 获取下一个字符
-char getChar() {
-    if (pos >= src.length()) return '\0';
-    return src[pos++];
-}
-
-// 获取关键字或标识符
-TokenInfo getIdentifierOrKeyword() {
-    string lexeme = "";
-    while (pos < src.length()) {
-        CharType ct = peekChar();
-        if (ct == Alphabet || ct == Number) {
-            lexeme += getChar();
-        } else {
-            break;
-        }
-    }
-    
-    // 检查是否为关键字
-    bool isKeyword = false;
-    for (const auto& keyword : Keywords) {
-        if (keyword == lexeme) {
-            isKeyword = true;
-            break;
-        }
-    }
-    
-    TokenInfo token;
-    token.id = tokenCount;
-    token.lexeme = lexeme;
-    
-    if (isKeyword) {
-        token.typeName = "Keyword";
-        token.typeId = typeNameMap[lexeme];
-    } else {
-        token.typeName = "Identifier";
-        token.typeId = 81;
-    }
-    
-    return token;
-}
-
-// 获取数字常量
-TokenInfo getNumber() {
-    string lexeme = "";
-    bool hasDot = false;
-    
-    while (pos < src.length()) {
-        CharType ct = peekChar();
-        if (ct == Number) {
-            lexeme += getChar();
-        } else if (ct == Dot && !hasDot) {
-            lexeme += getChar();
-            hasDot = true;
-        } else {
-            break;
-        }
+// 词法分析器（DFA编译期由LexerDFA.h中的token集合生成）：标识符可含下划线，'\r'按空白处理
+typedef Lexer<LEX_UNDERSCORE_IN_IDENTIFIERS | LEX_CARRIAGE_RETURN_IS_BLANK> ServerLexer;
+
+// token种类对应的类型名：引号内的内容按标识符输出，引号和未知字符按运算符
+const char* tokenTypeName(LexKind kind) {
+    switch (kind) {
+        case LEX_KEYWORD: return "Keyword";
+        case LEX_CONSTANT: return "Constant";
+        case LEX_COMMENT: return "Comment";
+        case LEX_IDENTIFIER: case LEX_STRING: return "Identifier";
+        default: return "Operator";
     }
-    
-    TokenInfo token;
-    token.id = tokenCount;
-    token.lexeme = lexeme;
-    token.typeName = "Constant";
-    token.typeId = 80;
-    
-    return token;
 }
 
-// 获取运算符
-TokenInfo getOperator() {
-    string lexeme = "";
-    lexeme += getChar();
-    
-    // 检查是否为多字符运算符
-    if (pos < src.length()) {
-        string twoChar = lexeme + src[pos];
-        if (typeNameMap.find(twoChar) != typeNameMap.end()) {
-            // 检查三个字符的运算符
-            if (pos + 1 < src.length()) {
-                string threeChar = twoChar + src[pos + 1];
-                if (typeNameMap.find(threeChar) != typeNameMap.end()) {
-                    lexeme = threeChar;
-                    pos += 2;
-                } else {
-                    // 两个字符的运算符
-                    lexeme = twoChar;
-                    pos++;
-                }
+// 输出一个token的JSON对象；lexeme和类型名只在这里才变成文本
+void writeTokenJSON(ostream& json, int id, string_view lexeme, const LexToken& token) {
+    json << "{";
+    json << "\"id\":" << id << ",";
+    json << "\"lexeme\":\"";
+    {
+        // 对lexeme进行JSON转义；控制字符使用Unicode转义
+        JsonEscapeBuf escape(json);
+        for (char c : lexeme) {
+            if (static_cast<unsigned char>(c) < 32 && c != '\b' && c != '\f' && c != '\n' && c != '\r' && c != '\t') {
+                char buf[7];
+                snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                escape.pubsync();
+                json << buf;
             } else {
-                // 两个字符的运算符
-                lexeme = twoChar;
-                pos++;
+                escape.sputc(c);
             }
         }
     }
-    
-    TokenInfo token;
-    token.id = tokenCount;
-    token.lexeme = lexeme;
-    
-    // 查找类型ID
-    if (typeNameMap.find(lexeme) != typeNameMap.end()) {
-        token.typeId = typeNameMap[lexeme];
-        token.typeName = "Operator";
-    } else {
-        // 如果找不到映射，设为未知运算符
-        token.typeId = 0;
-        token.typeName = "Operator";
-    }
-    
-    return token;
+    json << "\",";
+    json << "\"typeName\":\"" << tokenTypeName(token.kind) << "\",";
+    json << "\"typeId\":" << (int)token.typeId;
+    json << "}";
 }
 
-// 处理注释或除法运算符
-TokenInfo getCommentOrOperator() {
-    // 消耗当前的 '/'
-    string lexeme = "/";
-    getChar();
-
-    if (pos >= src.length()) {
-        TokenInfo token;
-        token.id = tokenCount;
-        token.lexeme = lexeme;
-        token.typeName = "Operator";
-        token.typeId = typeNameMap[lexeme];
-        return token;
-    }
-
-    char nextChar = src[pos];
-
-    // 单行注释：//...
-    if (nextChar == '/') {
-        lexeme += '/';
-        pos++; // 消耗第二个 '/'
-
-        // 读取直到行尾（不包含换行符）
-        while (pos < src.length() && src[pos] != '\n' && src[pos] != '\r') {
-            lexeme += src[pos];
-            pos++;
-        }
-
-        TokenInfo token;
-        token.id = tokenCount;
-        token.lexeme = lexeme;
-        token.typeName = "Comment";
-        token.typeId = 79;
-        return token;
-    }
-    // 多行注释：/* ... */
-    else if (nextChar == '*') {
-        lexeme += '*';
-        pos++; // 消耗 '*'
-
-        while (pos < src.length()) {
-            if (src[pos] == '*' && pos + 1 < src.length() && src[pos + 1] == '/') {
-                lexeme += "*/";
-                pos += 2; // 消耗 '*/'
-                break;
-            }
-            lexeme += src[pos];
-            pos++;
-        }
+// 识别下一个token，源码已经读完时返回false。
+// 状态都在lexer对象里，各个请求各用一个，直接读请求里的源码而不复制；
+// token只记录位置和种类，识别过程中不分配内存
+bool nextToken(ServerLexer& lexer, LexToken& token) {
+    checkBudget();
+    return lexer.next(token);
+}
 
-        TokenInfo token;
-        token.id = tokenCount;
-        token.lexeme = lexeme;
-        token.typeName = "Comment";
-        token.typeId = 79;
-        return token;
-    }
-    // 除法赋值运算符：/=
-    else if (nextChar == '=') {
-        lexeme += '=';
-        pos++; // 消耗 '='
-
-        TokenInfo token;
-        token.id = tokenCount;
-        token.lexeme = lexeme;
-        token.typeName = "Operator";
-        token.typeId = typeNameMap[lexeme];
-        return token;
-    }
-    // 普通除法运算符：/
-    else {
-        TokenInfo token;
-        token.id = tokenCount;
-        token.lexeme = lexeme;
-        token.typeName = "Operator";
-        token.typeId = typeNameMap[lexeme];
-        return token;
-    }
-}
-
-// 处理引号内的内容
-TokenInfo getQuoteContent() {
-    TokenInfo token;
-    token.id = tokenCount;
-    if (quoteStatus == 0) {
-        token.lexeme = "\"";
-        token.typeName = "Operator";
-        token.typeId = 78;
-        pos++;
-        quoteStatus = 1;
-    } else if (quoteStatus == 1) {
-        token.lexeme = "";
-        while (pos < src.length() && src[pos] != '"') {
-            token.lexeme += src[pos];
-            pos++;
+// 各类token的数量
+struct TokenStats {
+    size_t total = 0, keywords = 0, identifiers = 0, constants = 0, operators = 0, comments = 0;
+
+    void add(const LexToken& token) {
+        total++;
+        switch (token.kind) {
+            case LEX_KEYWORD: keywords++; break;
+            case LEX_IDENTIFIER: case LEX_STRING: identifiers++; break;
+            case LEX_CONSTANT: constants++; break;
+            case LEX_COMMENT: comments++; break;
+            default: operators++; break;
         }
-        token.typeName = "Identifier";
-        token.typeId = 81;
-        quoteStatus = 2;
-    } else {
-        token.lexeme = "\"";
-        token.typeName = "Operator";
-        token.typeId = 78;
-        pos++;
-        quoteStatus = 0;
     }
-    return token;
-}
+};
 
-// 简单的JSON生成函数
-string generateJSON(const vector<TokenInfo>& tokens) {
-    stringstream json;
+// 词法分析，边识别边把token写入json，不保留整个token数组
+void analyzeCodeTo(const string& code, ostream& json) {
+    PhaseTimer phase("lex");
+    ServerLexer lexer(code);
+    TokenStats stats;
+    LexToken token;
     json << "{\"tokens\":[";
-    
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        const auto& token = tokens[i];
-        json << "{";
-        json << "\"id\":" << token.id << ",";
-        
-        // 对lexeme进行JSON转义
-        string escapedLexeme;
-        for (char c : token.lexeme) {
-            switch (c) {
-                case '"': escapedLexeme += "\\\""; break;
-                case '\\': escapedLexeme += "\\\\"; break;
-                case '\b': escapedLexeme += "\\b"; break;
-                case '\f': escapedLexeme += "\\f"; break;
-                case '\n': escapedLexeme += "\\n"; break;
-                case '\r': escapedLexeme += "\\r"; break;
-                case '\t': escapedLexeme += "\\t"; break;
-                default:
-                    // 对于控制字符，使用Unicode转义
-                    if (static_cast<unsigned char>(c) < 32) {
-                        char buf[7];
-                        snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
-                        escapedLexeme += buf;
-                    } else {
-                        escapedLexeme += c;
-                    }
-                    break;
-            }
-        }
-        
-        json << "\"lexeme\":\"" << escapedLexeme << "\",";
-        json << "\"typeName\":\"" << token.typeName << "\",";
-        json << "\"typeId\":" << token.typeId;
-        json << "}";
-        if (i < tokens.size() - 1) json << ",";
+    while (nextToken(lexer, token)) {
+        if (stats.total > 0) json << ",";
+        stats.add(token);
+        writeTokenJSON(json, (int)stats.total, lexer.lexeme(token), token);
     }
-    
     json << "],\"stats\":{";
-    json << "\"total\":" << tokens.size() << ",";
-    json << "\"keywords\":" << count_if(tokens.begin(), tokens.end(), 
-        [](const TokenInfo& t) { return t.typeName == "Keyword"; }) << ",";
-    json << "\"identifiers\":" << count_if(tokens.begin(), tokens.end(), 
-        [](const TokenInfo& t) { return t.typeName == "Identifier"; }) << ",";
-    json << "\"constants\":" << count_if(tokens.begin(), tokens.end(), 
-        [](const TokenInfo& t) { return t.typeName == "Constant"; }) << ",";
-    json << "\"operators\":" << count_if(tokens.begin(), tokens.end(), 
-        [](const TokenInfo& t) { return t.typeName == "Operator"; }) << ",";
-    json << "\"comments\":" << count_if(tokens.begin(), tokens.end(), 
-        [](const TokenInfo& t) { return t.typeName == "Comment"; });
+    json << "\"total\":" << stats.total << ",";
+    json << "\"keywords\":" << stats.keywords << ",";
+    json << "\"identifiers\":" << stats.identifiers << ",";
+    json << "\"constants\":" << stats.constants << ",";
+    json << "\"operators\":" << stats.operators << ",";
+    json << "\"comments\":" << stats.comments;
     json << "}}";
-    
-    return json.str();
 }
 
+// 同一结果的CBOR编码：结构与JSON相同，重复出现的类型名、成员名经字符串表共享
+void analyzeCodeToCBOR(const string& code, ostream& out) {
+    PhaseTimer phase("lex");
+    ServerLexer lexer(code);
+    TokenStats stats;
+    LexToken token;
+    CborWriter cbor(out);
+    cbor.beginMap(2);
+    cbor.key("tokens");
+    cbor.beginArray();
+    while (nextToken(lexer, token)) {
+        stats.add(token);
+        cbor.beginMap(4);
+        cbor.key("id");
+        cbor.integer(stats.total);
+        cbor.key("lexeme");
+        cbor.text(lexer.lexeme(token));
+        cbor.key("typeName");
+        cbor.text(tokenTypeName(token.kind));
+        cbor.key("typeId");
+        cbor.integer(token.typeId);
+    }
+    cbor.end();
+    cbor.key("stats");
+    cbor.beginMap(6);
+    cbor.key("total");
+    cbor.integer(stats.total);
+    cbor.key("keywords");
+    cbor.integer(stats.keywords);
+    cbor.key("identifiers");
+    cbor.integer(stats.identifiers);
+    cbor.key("constants");
+    cbor.integer(stats.constants);
+    cbor.key("operators");
+    cbor.integer(stats.operators);
+    cbor.key("comments");
+    cbor.integer(stats.comments);
+}
 
 string analyzeCode(const string& code) {
-    src = code;
-    pos = 0;
-    tokenCount = 0;
-    quoteStatus = 0;
-    vector<TokenInfo> tokens;
-    while (pos < src.length()) {
-        while (pos < src.length()) {
-            char c = src[pos];
-            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') { pos++; }
-            else { break; }
-        }
-        if (pos >= src.length()) break;
-        tokenCount++;
-        char currentChar = src[pos];
-        TokenInfo token;
-        if (quoteStatus > 0) {
-            token = getQuoteContent();
-        } else if (isalpha(currentChar) || currentChar == '_') {
-            token = getIdentifierOrKeyword();
-        } else if (isdigit(currentChar)) {
-            token = getNumber();
-        } else if (currentChar == '/') {
-            token = getCommentOrOperator();
-        } else if (currentChar == '"') {
-            token = getQuoteContent();
-        } else {
-            token = getOperator();
-        }
-        tokens.push_back(token);
-    }
-    return generateJSON(tokens);
+    stringstream json;
+    analyzeCodeTo(code, json);
+    return json.str();
 }
 
 // LL(1) parser implementation
@@ -435,7 +222,10 @@ static map<string, vector<vector<string>>> LLGrammar = {
     {"simpleexpr", {{"ID"}, {"NUM"}, {"(", "arithexpr", ")"}}}
 };
 
-static map<pair<string, string>, vector<string>> LLParseTable; // Will be populated by generator
+typedef map<pair<string, string>, vector<string>> LLTable;
+static LLTable LLParseTable; // Will be populated by generator
+// 分片运行时线程查自己分片的LL分析表副本，未设置时查全局表
+thread_local const LLTable* activeLLTable = nullptr;
 
 static set<string> LLTerminals = {"{", "}", "if", "(", ")", "then", "else", "while",
     "ID", "=", ">", "<", ">=", "<=", "==", "+", "-",
@@ -448,6 +238,7 @@ vector<LLToken> llTokenize(const string& prog) {
     int lineNum = 1;
     bool lastLineHadTokens = false;
     while (getline(iss, line)) {
+        checkBudget();
         istringstream ls(line);
         string tk;
         bool lineHasTokens = false;
@@ -476,26 +267,35 @@ struct ASTNode {
     vector<ASTNode> children;
 };
 
-string astToJson(const ASTNode& node) {
-    stringstream ss;
-    ss << "{";
+void writeAstJSON(ostream& json, const ASTNode& node) {
+    json << "{";
     string escaped;
     for (char c : node.name) {
         if (c == '"') escaped += "\\\"";
         else if (c == '\\') escaped += "\\\\";
         else escaped += c;
     }
-    ss << "\"name\":\"" << escaped << "\"";
+    json << "\"name\":\"" << escaped << "\"";
     if (!node.children.empty()) {
-        ss << ",\"children\":[";
+        json << ",\"children\":[";
         for (size_t i = 0; i < node.children.size(); ++i) {
-            ss << astToJson(node.children[i]);
-            if (i < node.children.size() - 1) ss << ",";
+            writeAstJSON(json, node.children[i]);
+            if (i < node.children.size() - 1) json << ",";
         }
-        ss << "]";
+        json << "]";
+    }
+    json << "}";
+}
+
+void writeAstCBOR(CborWriter& cbor, const ASTNode& node) {
+    cbor.beginMap(node.children.empty() ? 1 : 2);
+    cbor.key("name");
+    cbor.text(node.name);
+    if (!node.children.empty()) {
+        cbor.key("children");
+        cbor.beginArray(node.children.size());
+        for (const ASTNode& child : node.children) writeAstCBOR(cbor, child);
     }
-    ss << "}";
-    return ss.str();
 }
 
 class LLParser {
@@ -507,6 +307,7 @@ public:
     bool hasError = false;
     int lastConsumedLine = 0;
     string tree;
+    ostream* treeOut = nullptr;  // 非空时推导树文本直接写到这里，不再累积到 tree
     ASTNode root;
 
     LLParser(const vector<LLToken>& t) : tokens(t) {}
@@ -532,12 +333,18 @@ public:
     void consume() { if (p < tokens.size()) { lastConsumedLine = tokens[p].line; ++p; } }
 
     void append(int depth, const string& s) {
+        if (treeOut) {
+            for (int i = 0; i < depth; ++i) *treeOut << '\t';
+            *treeOut << s << '\n';
+            return;
+        }
         for (int i = 0; i < depth; ++i) tree += "\t";
         tree += s;
         tree += "\n";
     }
 
     bool parse(const string& symbol, int depth, bool output, ASTNode* currentNode = nullptr) {
+        checkBudget();  // 超出请求的时间预算时抛出 BudgetExceeded
         if (currentNode) currentNode->name = symbol;
 
         if (symbol == "E") { 
@@ -563,7 +370,9 @@ public:
         string cur = peek().value;
         string curType = get_token_type(cur);
         auto key = make_pair(symbol, curType);
-        if (LLParseTable.count(key) == 0) {
+        const LLTable& table = activeLLTable ? *activeLLTable : LLParseTable;
+        auto entry = table.find(key);
+        if (entry == table.end()) {
             if ((symbol == "stmts" && cur == "}") ||
                 (symbol == "arithexprprime" && (cur == ")" || cur == ";" || cur == "$" ||
                     cur == "<" || cur == ">" || cur == "<=" || cur == ">=" || cur == "==" || cur == "}")) ||
@@ -578,7 +387,7 @@ public:
             hasError = true;
             return false;
         }
-        const vector<string>& prod = LLParseTable[key];
+        const vector<string>& prod = entry->second;
         for (const string& s : prod) {
             ASTNode child;
             if (!parse(s, depth + 1, output, output ? &child : nullptr)) return false;
@@ -691,17 +500,18 @@ public:
     }
 };
 
-SymbolTable IDMap;
+// 符号表（每个工作线程各自一份）
+thread_local SymbolTable IDMap;
 
-void conversionError(int lineNum) {
-    printf("error message:line %d,realnum can not be translated into int type\n", lineNum);
+void conversionError(string& out, int lineNum) {
+    out += "error message:line " + to_string(lineNum) + ",realnum can not be translated into int type\n";
 }
 
-void divisionByZeroError(int lineNum) {
-    printf("error message:line %d,division by zero\n", lineNum);
+void divisionByZeroError(string& out, int lineNum) {
+    out += "error message:line " + to_string(lineNum) + ",division by zero\n";
 }
 
-double executeAssign(Identifier* target, Identifier* left, Identifier* right, char op, int lineNum) {
+double executeAssign(Identifier* target, Identifier* left, Identifier* right, char op, int lineNum, string& out) {
     double result = 0;
     switch (op) {
         case '+': result = left->value + right->value; break;
@@ -709,7 +519,7 @@ double executeAssign(Identifier* target, Identifier* left, Identifier* right, ch
         case '*': result = left->value * right->value; break;
         case '/':
             if (right->value == 0) {
-                divisionByZeroError(lineNum);
+                divisionByZeroError(out, lineNum);
                 return 0;
             }
             result = left->value / right->value; 
@@ -731,6 +541,7 @@ class Translator {
     vector<string> tokens;
     int pos = 0, lineNum = 1;
     bool hasError = false;
+    string output;  // 翻译结果，代替直接写stdout
     
     void forward(int count) {
         for (int i = 0; i < count;) {
@@ -770,7 +581,7 @@ class Translator {
         
         if (type == "int") {
             if (valueStr.find('.') != string::npos) {
-                conversionError(lineNum);
+                conversionError(output, lineNum);
                 hasError = true;
             }
             IDMap[name] = Identifier(name, false, stod(valueStr));
@@ -791,7 +602,7 @@ class Translator {
         Identifier* left = getValue(leftStr);
         Identifier* right = getValue(rightStr);
         
-        executeAssign(target, left, right, op, lineNum);
+        executeAssign(target, left, right, op, lineNum, output);
         
         forward(5);
         
@@ -805,7 +616,7 @@ class Translator {
                 Identifier* right2 = getValue(nextRight);
                 Identifier* left2 = new Identifier("temp", target->isReal, target->value);
                 
-                executeAssign(target, left2, right2, op2, lineNum);
+                executeAssign(target, left2, right2, op2, lineNum, output);
                 forward(1);
             }
         }
@@ -862,11 +673,14 @@ class Translator {
         for (const auto& key : keys) {
             auto& val = IDMap[key];
             if (key != "temp") {
+                char buf[64];
                 if (val.isReal) {
-                    printf("%s: %g\n", key.c_str(), val.value);
+                    snprintf(buf, sizeof(buf), ": %g\n", val.value);
                 } else {
-                    printf("%s: %d\n", key.c_str(), (int)val.value);
+                    snprintf(buf, sizeof(buf), ": %d\n", (int)val.value);
                 }
+                output += key;
+                output += buf;
             }
         }
     }
@@ -879,6 +693,7 @@ public:
     
     void translate() {
         while (pos < tokens.size()) {
+            checkBudget();
             string token = tokens[pos];
             if (token == "$") {
                 if (!hasError) printResult();
@@ -905,144 +720,170 @@ public:
             }
         }
     }
+
+    const string& getOutput() const { return output; }
 };
 
-string llParseToJSON(const string& code) {
-    auto tokens = llTokenize(code);
-    LLParser parser(tokens);
+// 第一遍分析只检查是否缺少分号，随后重置分析器，准备输出推导树
+void llCheck(LLParser& parser, bool& miss, int& line) {
+    PhaseTimer phase("check");
     parser.parse("program", 0, false);
-    bool miss = parser.semicolonMissing;
-    int line = parser.missingLine;
+    miss = parser.semicolonMissing;
+    line = parser.missingLine;
     parser.reset();
-    parser.parse("program", 0, true, &parser.root);
-    string t = parser.tree;
-    stringstream json;
-    // Build JSON safely (escape tree text)
-    string escaped;
-    for (char c : t) {
-        switch (c) {
-            case '"': escaped += "\\\""; break;
-            case '\\': escaped += "\\\\"; break;
-            case '\b': escaped += "\\b"; break;
-            case '\f': escaped += "\\f"; break;
-            case '\n': escaped += "\\n"; break;
-            case '\r': escaped += "\\r"; break;
-            case '\t': escaped += "\\t"; break;
-            default: escaped += c; break;
-        }
+}
+
+void llParseTo(const string& code, ostream& json) {
+    vector<LLToken> tokens;
+    {
+        PhaseTimer phase("tokenize");
+        tokens = llTokenize(code);
+    }
+    LLParser parser(tokens);
+    bool miss;
+    int line;
+    llCheck(parser, miss, line);
+    json << "{\"tree\":\"";
+    {
+        // 推导树文本边生成边转义输出
+        PhaseTimer phase("parse");
+        JsonEscapeBuf escape(json);
+        ostream treeOut(&escape);
+        parser.treeOut = &treeOut;
+        parser.parse("program", 0, true, &parser.root);
     }
-    json << "{\"tree\":\"" << escaped << "\",";
+    json << "\",";
     json << "\"missingSemicolon\":" << (miss ? "true" : "false") << ",";
     json << "\"missingLine\":" << line << ",";
     json << "\"syntaxError\":" << (parser.hasError ? "true" : "false") << ",";
-    json << "\"ast\":" << astToJson(parser.root) << "}";
+    json << "\"ast\":";
+    {
+        PhaseTimer phase("ast");
+        writeAstJSON(json, parser.root);
+    }
+    json << "}";
+}
+
+string llParseToJSON(const string& code) {
+    stringstream json;
+    llParseTo(code, json);
     return json.str();
 }
 
-string lrParseToJSON(const string& code) {
+void llParseToCBOR(const string& code, ostream& out) {
+    vector<LLToken> tokens;
+    {
+        PhaseTimer phase("tokenize");
+        tokens = llTokenize(code);
+    }
+    LLParser parser(tokens);
+    bool miss;
+    int line;
+    llCheck(parser, miss, line);
+    CborWriter cbor(out);
+    cbor.beginMap(5);
+    cbor.key("tree");
+    {
+        PhaseTimer phase("parse");
+        CborTextBuf text(cbor);
+        ostream treeOut(&text);
+        parser.treeOut = &treeOut;
+        parser.parse("program", 0, true, &parser.root);
+    }
+    cbor.key("missingSemicolon");
+    cbor.boolean(miss);
+    cbor.key("missingLine");
+    cbor.integer(line);
+    cbor.key("syntaxError");
+    cbor.boolean(parser.hasError);
+    cbor.key("ast");
+    PhaseTimer phase("ast");
+    writeAstCBOR(cbor, parser.root);
+}
+
+// 先以检查模式分析一遍，从错误信息中取出缺少分号的行号
+void lrCheck(const string& code, bool& miss, int& line) {
     stringstream errss;
-    streambuf* oldbuf = cout.rdbuf(errss.rdbuf());
     {
-        Parser p(code);
+        PhaseTimer phase("check");
+        Parser p(code, errss, checkBudget);
         p.set_mode(MODE_ERROR_CHECKING);
         p.parse();
     }
-    cout.rdbuf(oldbuf);
-    bool miss = false;
-    int line = 0;
-    {
-        string s = errss.str();
-        size_t pos = s.find("语法错误");
-        if (pos != string::npos) {
-            miss = true;
-            size_t lp = s.find("第", pos);
-            size_t lp2 = s.find("行", lp);
-            if (lp != string::npos && lp2 != string::npos) {
-                string num = s.substr(lp + 3, lp2 - (lp + 3));
-                line = atoi(num.c_str());
-            }
+    miss = false;
+    line = 0;
+    string s = errss.str();
+    size_t pos = s.find("语法错误");
+    if (pos != string::npos) {
+        miss = true;
+        size_t lp = s.find("第", pos);
+        size_t lp2 = s.find("行", lp);
+        if (lp != string::npos && lp2 != string::npos) {
+            string num = s.substr(lp + 3, lp2 - (lp + 3));
+            line = atoi(num.c_str());
         }
     }
-    string tree;
-    stringstream outss;
-    oldbuf = cout.rdbuf(outss.rdbuf());
+}
+
+void lrParseTo(const string& code, ostream& json) {
+    bool miss;
+    int line;
+    lrCheck(code, miss, line);
+    json << "{\"tree\":\"";
     {
-        Parser p(code);
+        // 推导过程边生成边转义输出
+        PhaseTimer phase("parse");
+        JsonEscapeBuf escape(json);
+        ostream treeOut(&escape);
+        Parser p(code, treeOut, checkBudget);
         p.set_mode(MODE_PARSE);
         p.parse();
     }
-    cout.rdbuf(oldbuf);
-    tree = outss.str();
-    string escaped;
-    for (char c : tree) {
-        switch (c) {
-            case '"': escaped += "\\\""; break;
-            case '\\': escaped += "\\\\"; break;
-            case '\b': escaped += "\\b"; break;
-            case '\f': escaped += "\\f"; break;
-            case '\n': escaped += "\\n"; break;
-            case '\r': escaped += "\\r"; break;
-            case '\t': escaped += "\\t"; break;
-            default: escaped += c; break;
-        }
-    }
-    stringstream json;
-    json << "{\"tree\":\"" << escaped << "\",";
+    json << "\",";
     json << "\"missingSemicolon\":" << (miss ? "true" : "false") << ",";
     json << "\"missingLine\":" << line << ",";
     json << "\"syntaxError\":false}";
+}
+
+void lrParseToCBOR(const string& code, ostream& out) {
+    bool miss;
+    int line;
+    lrCheck(code, miss, line);
+    CborWriter cbor(out);
+    cbor.beginMap(4);
+    cbor.key("tree");
+    {
+        PhaseTimer phase("parse");
+        CborTextBuf text(cbor);
+        ostream treeOut(&text);
+        Parser p(code, treeOut, checkBudget);
+        p.set_mode(MODE_PARSE);
+        p.parse();
+    }
+    cbor.key("missingSemicolon");
+    cbor.boolean(miss);
+    cbor.key("missingLine");
+    cbor.integer(line);
+    cbor.key("syntaxError");
+    cbor.boolean(false);
+}
+
+string lrParseToJSON(const string& code) {
+    stringstream json;
+    lrParseTo(code, json);
     return json.str();
 }
 
 string translationToJSON(const string& code) {
     IDMap.clear();
     string prog = code;
-    string output;
-#ifdef _WIN32
-    int oldfd = _dup(_fileno(stdout));
-    FILE* tmp = tmpfile();
-    if (tmp) {
-        _dup2(_fileno(tmp), _fileno(stdout));
-        Translator t(prog);
-        t.translate();
-        fflush(stdout);
-        fseek(tmp, 0, SEEK_SET);
-        char buf[1024];
-        while (true) {
-            size_t n = fread(buf, 1, sizeof(buf), tmp);
-            if (n == 0) break;
-            output.append(buf, n);
-        }
-        _dup2(oldfd, _fileno(stdout));
-        fclose(tmp);
-        _close(oldfd);
-    } else {
-        Translator t(prog);
-        t.translate();
-    }
-#else
-    int oldfd = dup(fileno(stdout));
-    FILE* tmp = tmpfile();
-    if (tmp) {
-        dup2(fileno(tmp), fileno(stdout));
-        Translator t(prog);
-        t.translate();
-        fflush(stdout);
-        fseek(tmp, 0, SEEK_SET);
-        char buf[1024];
-        while (true) {
-            size_t n = fread(buf, 1, sizeof(buf), tmp);
-            if (n == 0) break;
-            output.append(buf, n);
-        }
-        dup2(oldfd, fileno(stdout));
-        fclose(tmp);
-        close(oldfd);
-    } else {
-        Translator t(prog);
+    Translator t(prog);
+    {
+        PhaseTimer phase("translate");
         t.translate();
     }
-#endif
+    PhaseTimer phase("escape");
+    const string& output = t.getOutput();
     string escaped;
     for (char c : output) {
         switch (c) {
@@ -1061,21 +902,22 @@ string translationToJSON(const string& code) {
     return json.str();
 }
 
-// 读取文件内容
-string readFile(const string& filename) {
-    ifstream file(filename, ios::binary);
-    if (!file) {
-        return "";
+void translateTo(const string& code, ostream& json) {
+    json << translationToJSON(code);
+}
+
+void translateToCBOR(const string& code, ostream& out) {
+    IDMap.clear();
+    string prog = code;
+    Translator t(prog);
+    {
+        PhaseTimer phase("translate");
+        t.translate();
     }
-    
-    string content;
-    file.seekg(0, ios::end);
-    content.resize(file.tellg());
-    file.seekg(0, ios::beg);
-    file.read(&content[0], content.size());
-    file.close();
-    
-    return content;
+    CborWriter cbor(out);
+    cbor.beginMap(1);
+    cbor.key("output");
+    cbor.text(t.getOutput());
 }
 
 // 获取文件MIME类型
@@ -1088,361 +930,2440 @@ string getMimeType(const string& filename) {
     return "text/plain; charset=utf-8";
 }
 
-// 简单的HTTP服务器
-void startServer() {
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        cerr << "WSAStartup failed" << endl;
-        return;
+// 静态资源缓存：启动时载入static目录，之后按需检查文件是否变化
+StaticAssetCache staticCache("static", getMimeType);
+
+// 处理请求的线程池，由 startServer 创建；批处理接口用它把任务分给多个核
+ThreadPool* workerPool = nullptr;
+
+// 分析结果缓存：键为（接口、分析表版本、code的哈希），值为最终的JSON字节
+ResultCache resultCache;
+uint64_t grammarVersion = 0;
+
+// 分片运行时每个分片独有的数据：结果缓存、静态资源缓存、分析表副本和线程池。
+// 分片的事件循环线程与工作线程经 currentShard 找到它，处理请求时不与其他分片共享数据
+// （运行指标除外，它们是全进程的原子计数）。不分片时 currentShard 为空，使用上面的全局对象
+struct ServerShard {
+    ResultCache results;
+    StaticAssetCache statics;
+    LLTable llTable;
+    LRTables lrTables;
+    ThreadPool* pool = nullptr;
+
+    explicit ServerShard(size_t cacheBytes)
+        : statics("static", getMimeType), llTable(LLParseTable), lrTables{reduction_rules, action_table, goto_table} {
+        results.setCapacity(cacheBytes);
     }
-#endif
 
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        cerr << "无法创建套接字" << endl;
-        return;
-    }
-    
-    int opt = 1;
-#ifdef _WIN32
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
-#else
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-#endif
+    // 让当前线程使用本分片的数据
+    void enter();
+};
+thread_local ServerShard* currentShard = nullptr;
 
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(8080);
-    
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        cerr << "绑定失败" << endl;
-        return;
+void ServerShard::enter() {
+    currentShard = this;
+    activeLLTable = &llTable;
+    activeLRTables = &lrTables;
+}
+
+// 正在运行的分片，供 /metrics 汇总
+mutex shardsMtx;
+vector<ServerShard*> runningShards;
+
+ResultCache& results() { return currentShard ? currentShard->results : resultCache; }
+StaticAssetCache& statics() { return currentShard ? currentShard->statics : staticCache; }
+ThreadPool* requestPool() { return currentShard ? currentShard->pool : workerPool; }
+
+// 运行指标：每个接口的请求数、耗时分布、字节数与处理中的请求数，GET /metrics 输出
+MetricsRegistry metrics("compiler_server_",
+                        {"/analyze", "/llparse", "/lrparse", "/translate", "/batch", "/ws", "/metrics", "static"},
+                        "other");
+
+// 分析表的指纹，作为缓存键中的版本：文法或表生成器改变后旧结果不会再被命中。
+// 各表项的哈希相加，与无序容器的遍历顺序无关
+uint64_t tableFingerprint() {
+    uint64_t version = 0;
+    auto add = [&](const string& a, const string& b, const string& c) {
+        uint64_t low, high;
+        hashBytes(a + '\0' + b + '\0' + c, low, high);
+        version += low;
+    };
+    for (const auto& entry : LLParseTable) {
+        string production;
+        for (const auto& sym : entry.second) production += sym + " ";
+        add(entry.first.first, entry.first.second, production);
     }
-    
-    if (listen(server_fd, 3) < 0) {
-        cerr << "监听失败" << endl;
-        return;
+    for (const auto& row : action_table) {
+        for (const auto& cell : row.second) add("action " + row.first, cell.first, cell.second);
     }
-    
-    cout << "服务器启动在 http://localhost:8080" << endl;
-    
-    while (true) {
-        int client_fd = accept(server_fd, nullptr, nullptr);
-        if (client_fd < 0) {
-            cerr << "接受连接失败" << endl;
-            continue;
-        }
-        
-        char buffer[8192] = {0};
-        int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_read > 0) {
-            string request(buffer);
-
-            // 检查是否有Content-Length，如果有，确保读完body
-            size_t header_end = request.find("\r\n\r\n");
-            if (header_end != string::npos) {
-                size_t cl_pos = request.find("Content-Length: ");
-                if (cl_pos != string::npos) {
-                    size_t cl_end = request.find("\r\n", cl_pos);
-                    if (cl_end != string::npos) {
-                        string cl_str = request.substr(cl_pos + 16, cl_end - (cl_pos + 16));
-                        int content_length = atoi(cl_str.c_str());
-                        int body_received = request.length() - (header_end + 4);
-                        
-                        while (body_received < content_length) {
-                            int n = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-                            if (n <= 0) break;
-                            buffer[n] = 0;
-                            request += buffer;
-                            body_received += n;
-                        }
-                    }
-                }
-            }
+    for (const auto& row : goto_table) {
+        for (const auto& cell : row.second) add("goto " + row.first, cell.first, cell.second);
+    }
+    for (const auto& rule : reduction_rules) {
+        add(rule.first, rule.second.left_symbol, to_string(rule.second.symbol_count));
+    }
+    return version;
+}
 
-            // 处理CORS预检请求
-            if (request.find("OPTIONS") == 0) {
-                string response = "HTTP/1.1 200 OK\r\n";
-                response += "Access-Control-Allow-Origin: *\r\n";
-                response += "Access-Control-Allow-Methods: POST, GET, OPTIONS\r\n";
-                response += "Access-Control-Allow-Headers: Content-Type\r\n";
-                response += "Content-Length: 0\r\n\r\n";
-                send(client_fd, response.c_str(), response.length(), 0);
-#ifdef _WIN32
-                closesocket(client_fd);
-#else
-                close(client_fd);
-#endif
-                continue;
-            }
-            
-            // 解析请求路径
-            string path = "/home.html"; // 默认路径
-            size_t path_start = request.find(" ");
-            if (path_start != string::npos) {
-                size_t path_end = request.find(" ", path_start + 1);
-                if (path_end != string::npos) {
-                    path = request.substr(path_start + 1, path_end - path_start - 1);
-                    if (path == "/") path = "/home.html";
-                }
-            }
-            
-            // 处理分析请求
-            if (request.find("POST /analyze") != string::npos) {
-                // 提取JSON数据
-                size_t json_start = request.find("\r\n\r\n");
-                if (json_start != string::npos) {
-                    string json_str = request.substr(json_start + 4);
-                    
-                    // 查找并解析 code 字段
-                    size_t code_key_pos = json_str.find("\"code\"");
-                    if (code_key_pos != string::npos) {
-                        size_t colon_pos = json_str.find(":", code_key_pos);
-                        if (colon_pos != string::npos) {
-                            size_t code_start = json_str.find("\"", colon_pos + 1);
-                            if (code_start != string::npos) {
-                                code_start += 1; // 跳过开始的"
-                                size_t code_end = code_start;
-                        bool escaped = false;
-                        while (code_end < json_str.size()) {
-                            char ch = json_str[code_end];
-                            if (escaped) { escaped = false; }
-                            else if (ch == '\\') { escaped = true; }
-                            else if (ch == '"') { break; }
-                            code_end++;
-                        }
-                        string encoded_code = json_str.substr(code_start, code_end - code_start);
-                        string decoded_code;
-                        for (size_t i = 0; i < encoded_code.length(); i++) {
-                            if (encoded_code[i] == '\\' && i + 1 < encoded_code.length()) {
-                                switch (encoded_code[i + 1]) {
-                                    case 'n': decoded_code += '\n'; i++; break;
-                                    case 'r': decoded_code += '\r'; i++; break;
-                                    case 't': decoded_code += '\t'; i++; break;
-                                    case '\\': decoded_code += '\\'; i++; break;
-                                    case '"': decoded_code += '"'; i++; break;
-                                    default: decoded_code += encoded_code[i]; break;
-                                }
-                            } else {
-                                decoded_code += encoded_code[i];
-                            }
-                        }
-                        string result = analyzeCode(decoded_code);
-                        string response = "HTTP/1.1 200 OK\r\n";
-                        response += "Content-Type: application/json\r\n";
-                        response += "Access-Control-Allow-Origin: *\r\n";
-                        response += "Content-Length: " + to_string(result.length()) + "\r\n";
-                        response += "\r\n";
-                        response += result;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                            }
-                        }
-                    } else {
-                        string response = "HTTP/1.1 400 Bad Request\r\n";
-                        response += "Content-Type: text/plain; charset=utf-8\r\n";
-                        string msg = "Missing 'code' field\n";
-                        response += "Content-Length: " + to_string(msg.length()) + "\r\n\r\n" + msg;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                    }
-                }
-            } else if (request.find("POST /llparse") != string::npos) {
-                size_t json_start = request.find("\r\n\r\n");
-                if (json_start != string::npos) {
-                    string json_str = request.substr(json_start + 4);
-                    size_t code_key_pos = json_str.find("\"code\"");
-                    if (code_key_pos != string::npos) {
-                        size_t colon_pos = json_str.find(":", code_key_pos);
-                        if (colon_pos != string::npos) {
-                            size_t code_start = json_str.find("\"", colon_pos + 1);
-                            if (code_start != string::npos) {
-                                code_start += 1;
-                                size_t code_end = code_start; bool escaped = false;
-                        while (code_end < json_str.size()) {
-                            char ch = json_str[code_end];
-                            if (escaped) { escaped = false; }
-                            else if (ch == '\\') { escaped = true; }
-                            else if (ch == '"') { break; }
-                            code_end++;
-                        }
-                        string encoded_code = json_str.substr(code_start, code_end - code_start);
-                        string decoded_code;
-                        for (size_t i = 0; i < encoded_code.length(); i++) {
-                            if (encoded_code[i] == '\\' && i + 1 < encoded_code.length()) {
-                                switch (encoded_code[i + 1]) {
-                                    case 'n': decoded_code += '\n'; i++; break;
-                                    case 'r': decoded_code += '\r'; i++; break;
-                                    case 't': decoded_code += '\t'; i++; break;
-                                    case '\\': decoded_code += '\\'; i++; break;
-                                    case '"': decoded_code += '"'; i++; break;
-                                    default: decoded_code += encoded_code[i]; break;
-                                }
-                            } else { decoded_code += encoded_code[i]; }
-                        }
-                        string result = llParseToJSON(decoded_code);
-                        string response = "HTTP/1.1 200 OK\r\n";
-                        response += "Content-Type: application/json\r\n";
-                        response += "Access-Control-Allow-Origin: *\r\n";
-                        response += "Content-Length: " + to_string(result.length()) + "\r\n\r\n";
-                        response += result;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                            }
-                        }
-                    } else {
-                        string response = "HTTP/1.1 400 Bad Request\r\n";
-                        response += "Content-Type: text/plain; charset=utf-8\r\n";
-                        string msg = "Missing 'code' field\n";
-                        response += "Content-Length: " + to_string(msg.length()) + "\r\n\r\n" + msg;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                    }
-                }
-            } else if (request.find("POST /lrparse") != string::npos) {
-                size_t json_start = request.find("\r\n\r\n");
-                if (json_start != string::npos) {
-                    string json_str = request.substr(json_start + 4);
-                    size_t code_key_pos = json_str.find("\"code\"");
-                    if (code_key_pos != string::npos) {
-                        size_t colon_pos = json_str.find(":", code_key_pos);
-                        if (colon_pos != string::npos) {
-                            size_t code_start = json_str.find("\"", colon_pos + 1);
-                            if (code_start != string::npos) {
-                                code_start += 1;
-                                size_t code_end = code_start; bool escaped = false;
-                        while (code_end < json_str.size()) {
-                            char ch = json_str[code_end];
-                            if (escaped) { escaped = false; }
-                            else if (ch == '\\') { escaped = true; }
-                            else if (ch == '"') { break; }
-                            code_end++;
-                        }
-                        string encoded_code = json_str.substr(code_start, code_end - code_start);
-                        string decoded_code;
-                        for (size_t i = 0; i < encoded_code.length(); i++) {
-                            if (encoded_code[i] == '\\' && i + 1 < encoded_code.length()) {
-                                switch (encoded_code[i + 1]) {
-                                    case 'n': decoded_code += '\n'; i++; break;
-                                    case 'r': decoded_code += '\r'; i++; break;
-                                    case 't': decoded_code += '\t'; i++; break;
-                                    case '\\': decoded_code += '\\'; i++; break;
-                                    case '"': decoded_code += '"'; i++; break;
-                                    default: decoded_code += encoded_code[i]; break;
-                                }
-                            } else { decoded_code += encoded_code[i]; }
-                        }
-                        string result = lrParseToJSON(decoded_code);
-                        string response = "HTTP/1.1 200 OK\r\n";
-                        response += "Content-Type: application/json\r\n";
-                        response += "Access-Control-Allow-Origin: *\r\n";
-                        response += "Content-Length: " + to_string(result.length()) + "\r\n\r\n";
-                        response += result;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                            }
-                        }
-                    } else {
-                        string response = "HTTP/1.1 400 Bad Request\r\n";
-                        response += "Content-Type: text/plain; charset=utf-8\r\n";
-                        string msg = "Missing 'code' field\n";
-                        response += "Content-Length: " + to_string(msg.length()) + "\r\n\r\n" + msg;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                    }
-                }
-            } else if (request.find("POST /translate") != string::npos) {
-                size_t json_start = request.find("\r\n\r\n");
-                if (json_start != string::npos) {
-                    string json_str = request.substr(json_start + 4);
-                    size_t code_key_pos = json_str.find("\"code\"");
-                    if (code_key_pos != string::npos) {
-                        size_t colon_pos = json_str.find(":", code_key_pos);
-                        if (colon_pos != string::npos) {
-                            size_t code_start = json_str.find("\"", colon_pos + 1);
-                            if (code_start != string::npos) {
-                                code_start += 1;
-                                size_t code_end = code_start; bool escaped = false;
-                        while (code_end < json_str.size()) {
-                            char ch = json_str[code_end];
-                            if (escaped) { escaped = false; }
-                            else if (ch == '\\') { escaped = true; }
-                            else if (ch == '"') { break; }
-                            code_end++;
-                        }
-                        string encoded_code = json_str.substr(code_start, code_end - code_start);
-                        string decoded_code;
-                        for (size_t i = 0; i < encoded_code.length(); i++) {
-                            if (encoded_code[i] == '\\' && i + 1 < encoded_code.length()) {
-                                switch (encoded_code[i + 1]) {
-                                    case 'n': decoded_code += '\n'; i++; break;
-                                    case 'r': decoded_code += '\r'; i++; break;
-                                    case 't': decoded_code += '\t'; i++; break;
-                                    case '\\': decoded_code += '\\'; i++; break;
-                                    case '"': decoded_code += '"'; i++; break;
-                                    default: decoded_code += encoded_code[i]; break;
-                                }
-                            } else { decoded_code += encoded_code[i]; }
-                        }
-                        string result = translationToJSON(decoded_code);
-                        string response = "HTTP/1.1 200 OK\r\n";
-                        response += "Content-Type: application/json\r\n";
-                        response += "Access-Control-Allow-Origin: *\r\n";
-                        response += "Content-Length: " + to_string(result.length()) + "\r\n\r\n";
-                        response += result;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                            }
-                        }
-                    } else {
-                        string response = "HTTP/1.1 400 Bad Request\r\n";
-                        response += "Content-Type: text/plain; charset=utf-8\r\n";
-                        string msg = "Missing 'code' field\n";
-                        response += "Content-Length: " + to_string(msg.length()) + "\r\n\r\n" + msg;
-                        send(client_fd, response.c_str(), response.length(), 0);
-                    }
-                }
-            } else {
-                // 提供静态文件
-                string filepath = "static" + path;
-                string content = readFile(filepath);
-                
-                string response;
-                if (!content.empty()) {
-                    response = "HTTP/1.1 200 OK\r\n";
-                    response += "Content-Type: " + getMimeType(filepath) + "\r\n";
-                    response += "Content-Length: " + to_string(content.length()) + "\r\n";
-                    response += "\r\n";
-                    response += content;
-                } else {
-                    // 文件未找到
-                    response = "HTTP/1.1 404 Not Found\r\n";
-                    response += "Content-Type: text/html; charset=utf-8\r\n";
-                    response += "\r\n";
-                    response += "<html><body><h1>404 Not Found</h1><p>文件 " + path + " 未找到</p></body></html>";
-                }
-                
-                send(client_fd, response.c_str(), response.length(), 0);
-            }
-        }
-        
+// 关闭套接字
+void closeSocket(int fd) {
 #ifdef _WIN32
-        closesocket(client_fd);
+    closesocket(fd);
 #else
-        close(client_fd);
-#endif
-    }
-    
-#ifdef _WIN32
-    WSACleanup();
+    close(fd);
 #endif
 }
 
-int main() {
-    // Generate LL(1) Table
-    cout << "Generating LL(1) Table..." << endl;
-    generateLLTableData(LLGrammar, LLTerminals, LLParseTable);
+// 服务器配置
+struct ServerConfig {
+    int port = 8080;
+    size_t workerThreads = thread::hardware_concurrency();
+    int keepAliveTimeout = 5;            // 空闲连接保持的秒数
+    int maxRequestsPerConnection = 100;  // 每个连接最多处理的请求数
+    size_t maxHeaderBytes = 16 * 1024;   // 请求行加请求头的上限，超出返回431
+    size_t maxBodyBytes = 4 * 1024 * 1024;  // 请求体上限，超出返回413
+    size_t resultCacheBytes = 64 * 1024 * 1024;  // 分析结果缓存的内存上限，0 表示关闭
+    int listenBacklog = SOMAXCONN;       // 等待accept的连接队列长度
+    size_t maxQueuedRequests = 256;      // 等待工作线程的请求数上限，超出返回503，0 表示不限
+    long requestTimeoutMs = 10000;       // 每个请求的处理时间上限（毫秒），0 表示不限
+    long requestCpuMs = 5000;            // 每个请求的CPU时间上限（毫秒），0 表示不限
+    int webSocketIdleTimeout = 300;      // WebSocket连接空闲多少秒后关闭
+    string ioBackend = "epoll";          // Linux下的事件循环后端：epoll 或 io_uring
+    int shards = 1;                      // 大于1时（仅Linux）按分片运行，每个分片一个事件循环并绑定一个CPU
+};
+
+// 一个HTTP响应，按顺序发送：head（状态行、响应头，可能已带正文）、body、
+// shared（owner 持有的只读数据，如缓存的压缩文件或分析结果）、tail（shared 之后的少量字节），
+// 最后是文件 fileFd 中从 fileOffset 起的 fileLength 字节（sendfile，零拷贝）。
+// 各部分分开存放、用一次 writev 写出，正文不会为了拼上响应头而再复制一遍
+struct HttpResponse {
+    string head;
+    string body;
+    string_view shared;
+    string tail;
+    int fileFd = -1;
+    size_t fileOffset = 0;
+    size_t fileLength = 0;
+    shared_ptr<const void> owner;  // 保证发送期间 shared 与文件描述符有效
+    // 流式正文：produce 非空时 head 只含状态行与普通响应头，正文由 produce 边计算边写出，
+    // 由发送方决定用 Content-Length 还是分块编码；stream 是事件循环中正在接收分块的队列
+    function<void(ostream&)> produce;
+    shared_ptr<ChunkQueue> stream;
+
+    HttpResponse() {}
+    HttpResponse(const string& raw) : head(raw) {}
+    HttpResponse(string&& raw) : head(move(raw)) {}
+
+    size_t memorySize() const { return head.size() + body.size() + shared.size() + tail.size(); }
+};
+
+// 判断Accept-Encoding是否接受某种编码（q=0 表示明确拒绝）
+bool acceptsEncoding(const string& acceptEncoding, const string& coding) {
+    size_t start = 0;
+    while (start < acceptEncoding.size()) {
+        size_t end = acceptEncoding.find(',', start);
+        if (end == string::npos) end = acceptEncoding.size();
+        string item = acceptEncoding.substr(start, end - start);
+        start = end + 1;
+
+        size_t semi = item.find(';');
+        string name = item.substr(0, semi);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        for (auto& ch : name) ch = tolower((unsigned char)ch);
+        if (name != coding && name != "*") continue;
+        if (semi == string::npos) return true;
+        size_t q = item.find("q=", semi);
+        return q == string::npos || atof(item.c_str() + q + 2) > 0;
+    }
+    return false;
+}
+
+// 提供静态文件：命中缓存后按Accept-Encoding选择压缩版本，If-None-Match匹配时返回304
+HttpResponse serveStatic(const HttpRequest& req) {
+    string path = req.path == "/" ? "/home.html" : req.path;
+    auto asset = statics().get(path);
+    if (!asset) {
+        // 文件未找到
+        string page = "<html><body><h1>404 Not Found</h1><p>文件 " + path + " 未找到</p></body></html>";
+        string response = "HTTP/1.1 404 Not Found\r\n";
+        response += "Content-Type: text/html; charset=utf-8\r\n";
+        response += "Content-Length: " + to_string(page.length()) + "\r\n";
+        response += "\r\n";
+        response += page;
+        return response;
+    }
+
+    // 每种编码是不同的表示，ETag 也各不相同；未压缩的正文在Linux下直接从文件sendfile
+    const string* body = &asset->body;
+    string encoding;
+    string etag = asset->etag;
+    string acceptEncoding = req.header("Accept-Encoding");
+    if (!asset->gzip.empty() && acceptsEncoding(acceptEncoding, "gzip")) {
+        body = &asset->gzip;
+        encoding = "gzip";
+    } else if (!asset->deflate.empty() && acceptsEncoding(acceptEncoding, "deflate")) {
+        body = &asset->deflate;
+        encoding = "deflate";
+    }
+    if (!encoding.empty()) etag.insert(etag.size() - 1, "-" + encoding);
+
+    string response;
+    string ifNoneMatch = req.header("If-None-Match");
+    bool notModified = !ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(etag) != string::npos);
+    response = notModified ? "HTTP/1.1 304 Not Modified\r\n" : "HTTP/1.1 200 OK\r\n";
+    response += "ETag: " + etag + "\r\n";
+    response += "Cache-Control: no-cache\r\n";
+    response += "Vary: Accept-Encoding\r\n";
+    if (notModified) {
+        response += "\r\n";
+        return response;
+    }
+    response += "Content-Type: " + asset->mime + "\r\n";
+    if (!encoding.empty()) response += "Content-Encoding: " + encoding + "\r\n";
+
+    HttpResponse result;
+    result.owner = asset;
+    if (encoding.empty() && asset->fd >= 0) {
+        response += "Content-Length: " + to_string(asset->size) + "\r\n\r\n";
+        result.fileFd = asset->fd;
+        result.fileLength = asset->size;
+    } else {
+        response += "Content-Length: " + to_string(body->length()) + "\r\n\r\n";
+        result.shared = *body;
+    }
+    result.head = move(response);
+    return result;
+}
+
+// 纯文本错误响应
+HttpResponse textResponse(const string& status, const string& msg) {
+    HttpResponse response;
+    response.head = "HTTP/1.1 " + status + "\r\n";
+    response.head += "Content-Type: text/plain; charset=utf-8\r\n";
+    response.head += "Access-Control-Allow-Origin: *\r\n";
+    response.head += "Content-Length: " + to_string(msg.length()) + "\r\n\r\n";
+    response.body = msg;
+    return response;
+}
+
+// 在状态行之后插入响应头（每行以\r\n结尾）
+void insertHeaders(HttpResponse& response, const string& headers) {
+    size_t status_end = response.head.find("\r\n");
+    response.head.insert(status_end == string::npos ? 0 : status_end + 2, headers);
+}
+
+// 工作线程队列已满：立即拒绝，让客户端稍后重试，而不是排在长队后面等待
+HttpResponse overloadedResponse() {
+    HttpResponse response = textResponse("503 Service Unavailable", "Server is overloaded, retry later\n");
+    insertHeaders(response, "Retry-After: 1\r\n");
+    return response;
+}
+
+// JSON响应：正文单独存放，不再与响应头拼接
+HttpResponse jsonResponse(string result) {
+    HttpResponse response;
+    response.head = "HTTP/1.1 200 OK\r\n";
+    response.head += "Content-Type: application/json\r\n";
+    response.head += "Access-Control-Allow-Origin: *\r\n";
+    response.head += "Content-Length: " + to_string(result.length()) + "\r\n\r\n";
+    response.body = move(result);
+    return response;
+}
+
+// 从JSON请求体中一次扫描取出并解码code字段，失败时在 error 中给出400响应
+bool decodeCode(const HttpRequest& req, string& code, HttpResponse& error) {
+    switch (decodeStringField(req.body, "code", code)) {
+        case JsonField::Missing: error = textResponse("400 Bad Request", "Missing 'code' field\n"); return false;
+        case JsonField::Malformed: error = textResponse("400 Bad Request", "Malformed JSON body\n"); return false;
+        case JsonField::Found: break;
+    }
+    return true;
+}
+
+typedef void (*Analyzer)(const string& code, ostream& json);
+
+// 分析接口：名称同时是路由路径、批处理的stage和缓存键的一部分
+const unordered_map<string, Analyzer> analyzers = {
+    {"analyze", analyzeCodeTo},
+    {"llparse", llParseTo},
+    {"lrparse", lrParseTo},
+    {"translate", translateTo},
+};
+
+// 同样结构的CBOR编码（RFC 8949），客户端以 Accept: application/cbor 选择
+const unordered_map<string, Analyzer> cborAnalyzers = {
+    {"analyze", analyzeCodeToCBOR},
+    {"llparse", llParseToCBOR},
+    {"lrparse", lrParseToCBOR},
+    {"translate", translateToCBOR},
+};
+
+// Accept中某个媒体类型的q值：精确匹配优先于 type/* 和 */*，未列出时为0
+double acceptQuality(const string& accept, const string& mediaType) {
+    string typeRange = mediaType.substr(0, mediaType.find('/')) + "/*";
+    double best = 0;
+    int bestSpecificity = -1;
+    size_t start = 0;
+    while (start < accept.size()) {
+        size_t end = accept.find(',', start);
+        if (end == string::npos) end = accept.size();
+        string item = accept.substr(start, end - start);
+        start = end + 1;
+
+        size_t semi = item.find(';');
+        string name = item.substr(0, semi);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        for (auto& ch : name) ch = tolower((unsigned char)ch);
+        int specificity = name == mediaType ? 2 : name == typeRange ? 1 : name == "*/*" ? 0 : -1;
+        if (specificity <= bestSpecificity) continue;
+        size_t q = semi == string::npos ? string::npos : item.find("q=", semi);
+        best = q == string::npos ? 1 : atof(item.c_str() + q + 2);
+        bestSpecificity = specificity;
+    }
+    return best;
+}
+
+// 只有客户端明确偏好CBOR时才使用，其余情况（包括没有Accept）仍返回JSON
+bool prefersCbor(const HttpRequest& req) {
+    string accept = req.header("Accept");
+    if (accept.empty()) return false;
+    double cbor = acceptQuality(accept, "application/cbor");
+    return cbor > 0 && cbor > acceptQuality(accept, "application/json");
+}
+
+// 查询串中是否带有某个开关，如 "timing=1" 或 "timing"
+bool hasQueryFlag(const string& query, const string& name) {
+    size_t start = 0;
+    while (start <= query.size()) {
+        size_t end = query.find('&', start);
+        if (end == string::npos) end = query.size();
+        string item = query.substr(start, end - start);
+        if (item == name || item == name + "=1" || item == name + "=true") return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// 查缓存，未命中时计算并存入
+shared_ptr<const string> cachedAnalysis(const string& name, Analyzer analyze, const string& code) {
+    ResultKey key = ResultCache::makeKey(name, grammarVersion, code);
+    if (auto cached = results().get(key)) return cached;
+    stringstream json;
+    analyze(code, json);
+    return results().put(key, move(json).str());
+}
+
+// 正文边计算边发送的200响应。HTTP/1.0 不支持分块编码，仍整体生成后发送
+HttpResponse producedResponse(const HttpRequest& req, const string& contentType, function<void(ostream&)> produce,
+                              const string& extraHeaders = "") {
+    HttpResponse response;
+    response.head = "HTTP/1.1 200 OK\r\n";
+    response.head += "Content-Type: " + contentType + "\r\n";
+    response.head += "Access-Control-Allow-Origin: *\r\n";
+    response.head += extraHeaders;
+    if (req.version != "HTTP/1.1") {
+        stringstream body;
+        produce(body);
+        response.body = move(body).str();
+        response.head += "Content-Length: " + to_string(response.body.size()) + "\r\n\r\n";
+        return response;
+    }
+    response.produce = move(produce);
+    return response;
+}
+
+// 分析接口：先查结果缓存，命中时正文直接引用缓存中的字节；
+// 未命中时结果边计算边发送，不在内存中拼出整个正文，同时留一份副本（不超过单项上限）存入缓存
+HttpResponse analysisEndpoint(const HttpRequest& req, const string& name) {
+    auto code = make_shared<string>();
+    HttpResponse error;
+    {
+        PhaseTimer phase("decode");
+        if (!decodeCode(req, *code, error)) return error;
+    }
+    // 按Accept选择编码；两种编码分别缓存
+    bool cbor = prefersCbor(req);
+    string contentType = cbor ? "application/cbor" : "application/json";
+    // ?timing=1：在JSON结果中附加各阶段耗时（CBOR只通过Server-Timing头给出）
+    bool timingInBody = !cbor && hasQueryFlag(req.query, "timing");
+    ResultKey key = ResultCache::makeKey(cbor ? name + ".cbor" : name, grammarVersion, *code);
+    shared_ptr<const string> cached;
+    {
+        PhaseTimer phase("cache");
+        cached = results().get(key);
+    }
+    if (cached) {
+        HttpResponse response;
+        response.head = "HTTP/1.1 200 OK\r\n";
+        response.head += "Content-Type: " + contentType + "\r\n";
+        response.head += "Access-Control-Allow-Origin: *\r\n";
+        response.head += "Vary: Accept\r\n";
+        response.head += "X-Cache: HIT\r\n";
+        response.shared = *cached;
+        response.owner = cached;
+        if (timingInBody && currentTiming && !cached->empty() && cached->back() == '}') {
+            // 结果的结尾 '}' 换成 timing 字段，缓存的字节原样引用
+            response.shared.remove_suffix(1);
+            response.tail = ",\"timing\":" + currentTiming->json() + "}";
+        }
+        response.head += "Content-Length: " + to_string(response.memorySize() - response.head.size()) + "\r\n\r\n";
+        return response;
+    }
+    Analyzer analyze = (cbor ? cborAnalyzers : analyzers).at(name);
+    auto produce = [code, key, analyze, timingInBody](ostream& json) {
+        // 需要附加耗时时扣住结尾的 '}'，分析完成后再补上 timing 字段
+        HoldBackBuf hold(json);
+        ostream held(&hold);
+        ostream& target = timingInBody && currentTiming ? held : json;
+        if (!results().enabled()) {
+            analyze(*code, target);
+        } else {
+            CapturingBuf capture(target, results().maxEntryBytes());
+            ostream out(&capture);
+            analyze(*code, out);
+            string result;
+            if (capture.take(result)) results().put(key, move(result));
+        }
+        if (&target == &held) {
+            char last = hold.takeLast();
+            if (last == '}') json << ",\"timing\":" << currentTiming->json() << "}";
+            else if (last) json << last;
+        }
+    };
+    return producedResponse(req, contentType, produce,
+                            string("Vary: Accept\r\n") + (results().enabled() ? "X-Cache: MISS\r\n" : ""));
+}
+
+// 一个批处理请求最多包含的条目数
+const size_t MAX_BATCH_ITEMS = 256;
+
+// 一次批处理：各线程用原子下标领取条目，结果按完成顺序登记
+struct BatchJob {
+    struct Item {
+        string stage;
+        Analyzer analyze = nullptr;
+        string code;
+        string error;  // 条目本身无效时的错误信息
+    };
+    vector<Item> items;
+    // 整个批处理共用一个截止时间，每个条目的时间预算不超过剩余的时间；CPU预算按条目各自计算
+    long wallLimitMs = 0;
+    long cpuLimitMs = 0;
+    chrono::steady_clock::time_point deadline;
+    atomic<size_t> next{0};
+    mutex mtx;
+    condition_variable cv;
+    vector<shared_ptr<const string>> results;
+    vector<bool> ready;
+    deque<size_t> completed;  // 完成顺序
+};
+
+// 领取并处理一个条目；已全部被领完时返回false
+bool runOneBatchItem(BatchJob& job) {
+    size_t i = job.next++;
+    if (i >= job.items.size()) return false;
+    const BatchJob::Item& item = job.items[i];
+    shared_ptr<const string> result;
+    long wallMs = job.wallLimitMs;
+    if (wallMs) {
+        wallMs = (long)chrono::duration_cast<chrono::milliseconds>(job.deadline - chrono::steady_clock::now()).count();
+    }
+    if (job.wallLimitMs && wallMs <= 0) {
+        // 截止时间已过：剩下的条目不再分析，使批处理不会长时间占用工作线程
+        result = make_shared<const string>("{\"error\":\"Batch exceeded its time limit of " +
+                                           to_string(job.wallLimitMs) + " ms\"}");
+    } else if (item.error.empty()) {
+        RequestBudget budget(wallMs, job.cpuLimitMs);
+        currentBudget = &budget;
+        try {
+            result = cachedAnalysis(item.stage, item.analyze, item.code);
+        } catch (const BudgetExceeded& e) {
+            metrics.overBudgetRequests++;
+            result = make_shared<const string>("{\"error\":\"" + string(e.what()) + "\"}");
+        }
+        currentBudget = nullptr;
+    } else {
+        result = make_shared<const string>("{\"error\":\"" + item.error + "\"}");
+    }
+    {
+        lock_guard<mutex> lock(job.mtx);
+        job.results[i] = move(result);
+        job.ready[i] = true;
+        job.completed.push_back(i);
+    }
+    job.cv.notify_all();
+    return true;
+}
+
+// 把批处理分到线程池执行并写出结果：默认按输入顺序输出JSON数组（前缀就绪即写出），
+// NDJSON 时按完成顺序每行输出一条。当前线程也参与领取条目，
+// 因此即使线程池的其他线程都在忙（或都在处理批处理），也不会互相等待而死锁
+void runBatch(const shared_ptr<BatchJob>& job, bool ndjson, ostream& out) {
+    // 各条目的阶段耗时不计入整个批处理请求的分解；时间预算见 BatchJob
+    RequestTiming* timing = currentTiming;
+    RequestBudget* budget = currentBudget;
+    currentTiming = nullptr;
+    struct Restore {
+        RequestTiming* timing;
+        RequestBudget* budget;
+        ~Restore() {
+            currentTiming = timing;
+            currentBudget = budget;
+        }
+    } restore{timing, budget};
+
+    size_t n = job->items.size();
+    ThreadPool* pool = requestPool();
+    size_t helpers = pool ? min(pool->size() - 1, n > 0 ? n - 1 : 0) : 0;
+    for (size_t h = 0; h < helpers; ++h) {
+        // 队列已满时不再加帮手，剩下的条目由当前线程处理
+        if (!pool->trySubmit([job] { while (runOneBatchItem(*job)) {} })) break;
+    }
+
+    if (!ndjson) out << "[";
+    size_t written = 0;
+    bool claiming = true;
+    while (written < n) {
+        if (claiming) claiming = runOneBatchItem(*job);
+        vector<pair<size_t, shared_ptr<const string>>> writable;
+        {
+            unique_lock<mutex> lock(job->mtx);
+            if (!claiming) {
+                job->cv.wait(lock, [&] { return ndjson ? !job->completed.empty() : (bool)job->ready[written]; });
+            }
+            if (ndjson) {
+                for (size_t i : job->completed) writable.emplace_back(i, move(job->results[i]));
+            } else {
+                for (size_t i = written; i < n && job->ready[i]; ++i) writable.emplace_back(i, move(job->results[i]));
+            }
+            job->completed.clear();
+        }
+        for (auto& w : writable) {
+            if (ndjson) out << "{\"index\":" << w.first << ",\"result\":" << *w.second << "}\n";
+            else out << (written > 0 ? "," : "") << *w.second;
+            written++;
+        }
+        if (!out) {  // 客户端已断开，剩下的条目不再领取
+            job->next = n;
+            return;
+        }
+    }
+    if (!ndjson) out << "]";
+}
+
+// 批处理接口：请求体为 [{"stage":"analyze|llparse|lrparse|translate","code":"..."}, ...]。
+// Accept 为 application/x-ndjson 时按完成顺序逐行返回 {"index":i,"result":...}
+HttpResponse batchEndpoint(const HttpRequest& req) {
+    vector<string_view> elements;
+    if (!splitJsonArray(req.body, elements)) {
+        return textResponse("400 Bad Request", "Expected a JSON array of {stage, code} items\n");
+    }
+    if (elements.size() > MAX_BATCH_ITEMS) {
+        return textResponse("413 Payload Too Large", "A batch may hold at most " + to_string(MAX_BATCH_ITEMS) + " items\n");
+    }
+    auto job = make_shared<BatchJob>();
+    job->items.resize(elements.size());
+    for (size_t i = 0; i < elements.size(); ++i) {
+        BatchJob::Item& item = job->items[i];
+        string stage;
+        switch (decodeStringField(elements[i], "stage", stage)) {
+            case JsonField::Missing: item.error = "Missing 'stage' field"; continue;
+            case JsonField::Malformed: item.error = "Malformed item"; continue;
+            case JsonField::Found: break;
+        }
+        auto found = analyzers.find(stage);
+        if (found == analyzers.end()) {
+            item.error = "Unknown stage";
+            continue;
+        }
+        item.stage = found->first;
+        item.analyze = found->second;
+        switch (decodeStringField(elements[i], "code", item.code)) {
+            case JsonField::Missing: item.error = "Missing 'code' field"; break;
+            case JsonField::Malformed: item.error = "Malformed item"; break;
+            case JsonField::Found: break;
+        }
+    }
+    job->results.resize(elements.size());
+    job->ready.assign(elements.size(), false);
+    if (currentBudget) {
+        job->wallLimitMs = currentBudget->wallLimit();
+        job->cpuLimitMs = currentBudget->cpuLimit();
+        job->deadline = chrono::steady_clock::now() + chrono::milliseconds(job->wallLimitMs);
+    }
+
+    string accept = req.header("Accept");
+    bool ndjson = accept.find("application/x-ndjson") != string::npos ||
+                  accept.find("application/ndjson") != string::npos;
+    return producedResponse(req, ndjson ? "application/x-ndjson" : "application/json",
+                            [job, ndjson](ostream& out) { runBatch(job, ndjson, out); });
+}
+
+// ---- WebSocket 实时分析 ----
+// 页面通过 GET /ws 升级为WebSocket后打开一个文档会话，之后只发送增量修改；
+// 服务器对最新版本重新分析，按阶段推送结果。消息均为JSON文本帧：
+//   客户端 → {"type":"open","code":"...","stages":["analyze","lrparse"],"version":0}
+//            {"type":"edit","version":1,"start":S,"end":E,"text":"..."}  把 [S,E) 替换为 text
+//            {"type":"stages","stages":[...]}
+//   服务器 → {"type":"result","version":V,"stage":"analyze","result":{...}}
+//            {"type":"error","message":"..."}
+// 偏移以 UTF-16 码元计（即浏览器中字符串的下标）
+
+// 是否是升级为WebSocket的请求
+bool isWebSocketUpgrade(const HttpRequest& req) {
+    string upgrade = req.header("Upgrade");
+    for (auto& ch : upgrade) ch = tolower((unsigned char)ch);
+    return req.method == "GET" && req.path == "/ws" && upgrade.find("websocket") != string::npos;
+}
+
+// 握手：accepted 为 true 时返回101响应，之后连接改用WebSocket帧；否则返回错误响应
+HttpResponse webSocketHandshake(const HttpRequest& req, bool& accepted) {
+    accepted = false;
+    string connection = req.header("Connection");
+    for (auto& ch : connection) ch = tolower((unsigned char)ch);
+    string key = req.header("Sec-WebSocket-Key");
+    if (req.version != "HTTP/1.1" || connection.find("upgrade") == string::npos ||
+        key.size() != 24 || key.compare(22, 2, "==") != 0) {
+        return textResponse("400 Bad Request", "Invalid WebSocket handshake\n");
+    }
+    if (req.header("Sec-WebSocket-Version") != "13") {
+        HttpResponse response = textResponse("426 Upgrade Required", "Only WebSocket version 13 is supported\n");
+        insertHeaders(response, "Sec-WebSocket-Version: 13\r\n");
+        return response;
+    }
+    accepted = true;
+    HttpResponse response;
+    response.head = "HTTP/1.1 101 Switching Protocols\r\n";
+    response.head += "Upgrade: websocket\r\n";
+    response.head += "Connection: Upgrade\r\n";
+    response.head += "Sec-WebSocket-Accept: " + webSocketAccept(key) + "\r\n\r\n";
+    return response;
+}
+
+// 不带升级头的 GET /ws
+HttpResponse webSocketOnly(const HttpRequest&) {
+    HttpResponse response = textResponse("426 Upgrade Required", "This endpoint only accepts WebSocket connections\n");
+    insertHeaders(response, "Upgrade: websocket\r\n");
+    return response;
+}
+
+// 把 UTF-16 码元偏移换算为 s 中的字节偏移；落在字符（或代理对）中间时返回false
+bool utf16ToByteOffset(const string& s, long long units, size_t& offset) {
+    if (units < 0) return false;
+    size_t i = 0;
+    long long seen = 0;
+    while (seen < units && i < s.size()) {
+        unsigned char c = s[i];
+        if (c < 0x80) { i++; seen++; }
+        else if (c >= 0xF0) { i += 4; seen += 2; }
+        else if (c >= 0xE0) { i += 3; seen++; }
+        else { i += 2; seen++; }
+    }
+    if (seen != units || i > s.size()) return false;
+    offset = i;
+    return true;
+}
+
+// WebSocket连接上的一个文档及其要分析的阶段（与套接字无关）
+struct DocumentSession {
+    string code;
+    long long version = 0;
+    vector<string> stages;
+    bool opened = false;
+    size_t maxBytes;
+
+    explicit DocumentSession(size_t limit) : maxBytes(limit) {}
+
+    // 解析 "stages":[...]，缺省时只做词法分析
+    bool readStages(string_view message, string& error) {
+        string_view raw;
+        JsonField found = findJsonMember(message, "stages", raw);
+        if (found == JsonField::Missing) {
+            if (stages.empty()) stages = {"analyze"};
+            return true;
+        }
+        vector<string_view> elements;
+        if (found == JsonField::Malformed || !splitJsonArray(raw, elements)) {
+            error = "'stages' must be an array of stage names";
+            return false;
+        }
+        vector<string> names;
+        for (string_view element : elements) {
+            string name;
+            size_t i = 1;
+            if (element.empty() || element[0] != '"' || !decodeJsonString(element, i, &name) || !analyzers.count(name)) {
+                error = "Unknown stage";
+                return false;
+            }
+            if (find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+        }
+        stages = move(names);
+        return true;
+    }
+
+    // 处理一条客户端消息。返回文档或阶段是否改变（需要重新分析）；出错时 error 非空
+    bool apply(string_view message, string& error) {
+        string type;
+        if (decodeStringField(message, "type", type) != JsonField::Found) {
+            error = "Missing 'type' field";
+            return false;
+        }
+        long long requested = version + 1;
+        JsonField hasVersion = decodeIntField(message, "version", requested);
+        if (hasVersion == JsonField::Malformed) {
+            error = "'version' must be an integer";
+            return false;
+        }
+        if (type == "open") {
+            string text;
+            if (decodeStringField(message, "code", text) != JsonField::Found) {
+                error = "Missing 'code' field";
+                return false;
+            }
+            if (text.size() > maxBytes) {
+                error = "Document exceeds " + to_string(maxBytes) + " bytes";
+                return false;
+            }
+            if (!readStages(message, error)) return false;
+            code = move(text);
+            version = hasVersion == JsonField::Found ? requested : 0;
+            opened = true;
+            return true;
+        }
+        if (!opened) {
+            error = "Send an 'open' message first";
+            return false;
+        }
+        if (type == "stages") {
+            return readStages(message, error);
+        }
+        if (type != "edit") {
+            error = "Unknown message type";
+            return false;
+        }
+        long long start, end;
+        string text;
+        size_t from, to;
+        if (decodeIntField(message, "start", start) != JsonField::Found ||
+            decodeIntField(message, "end", end) != JsonField::Found ||
+            decodeStringField(message, "text", text) != JsonField::Found) {
+            error = "An edit needs integer 'start' and 'end' and a string 'text'";
+            return false;
+        }
+        if (start > end || !utf16ToByteOffset(code, start, from) || !utf16ToByteOffset(code, end, to)) {
+            error = "Edit range is outside the document";
+            return false;
+        }
+        if (code.size() - (to - from) + text.size() > maxBytes) {
+            error = "Document exceeds " + to_string(maxBytes) + " bytes";
+            return false;
+        }
+        code.replace(from, to - from, text);
+        version = requested;
+        return true;
+    }
+};
+
+string webSocketError(const string& message) {
+    return webSocketFrame(WS_TEXT, "{\"type\":\"error\",\"message\":\"" + message + "\"}");
+}
+
+// 对文档的一个版本依次运行各阶段（经结果缓存），每完成一个阶段就交出一个结果帧。
+// 每个阶段有各自的时间预算
+void analyzeDocument(const string& code, long long version, const vector<string>& stages, const ServerConfig& config,
+                     const function<void(HttpResponse&&)>& emit) {
+    for (const string& stage : stages) {
+        shared_ptr<const string> result;
+        RequestBudget budget(config.requestTimeoutMs, config.requestCpuMs);
+        currentBudget = &budget;
+        try {
+            result = cachedAnalysis(stage, analyzers.at(stage), code);
+        } catch (const BudgetExceeded& e) {
+            metrics.overBudgetRequests++;
+            result = make_shared<const string>("{\"error\":\"" + string(e.what()) + "\"}");
+        }
+        currentBudget = nullptr;
+        // 词法分析按字节切分非ASCII字符，结果中可能出现不完整的UTF-8序列
+        if (!validUtf8(*result)) result = make_shared<const string>(toValidUtf8(*result));
+        // 帧头与结果之前的字段放在 head，结果本身原样引用，不拼接复制
+        string prefix = "{\"type\":\"result\",\"version\":" + to_string(version) + ",\"stage\":\"" + stage +
+                        "\",\"result\":";
+        HttpResponse frame(webSocketFrameHeader(WS_TEXT, prefix.size() + result->size() + 1) + prefix);
+        frame.shared = *result;
+        frame.owner = result;
+        frame.tail = "}";
+        emit(move(frame));
+    }
+}
+
+// 处理一条完整的WebSocket消息：回复的帧追加到 replies；返回文档是否需要重新分析。
+// closing 置为 true 表示已回复关闭帧，之后不再接收数据
+bool handleWebSocketMessage(DocumentSession& session, int opcode, string& payload, vector<string>& replies,
+                            bool& closing) {
+    switch (opcode) {
+        case WS_PING:
+            replies.push_back(webSocketFrame(WS_PONG, payload));
+            return false;
+        case WS_PONG:
+            return false;
+        case WS_CLOSE: {
+            // 回显对方的状态码（没有则不带状态码）
+            replies.push_back(webSocketFrame(WS_CLOSE, payload.substr(0, payload.size() >= 2 ? 2 : 0)));
+            closing = true;
+            return false;
+        }
+        case WS_BINARY:
+            replies.push_back(webSocketCloseFrame(WS_UNSUPPORTED_DATA, "Binary messages are not supported"));
+            closing = true;
+            return false;
+        default: {
+            string error;
+            bool changed = session.apply(payload, error);
+            if (!error.empty()) replies.push_back(webSocketError(error));
+            return changed;
+        }
+    }
+}
+
+// 处理CORS预检请求
+HttpResponse corsPreflight(const HttpRequest&) {
+    string response = "HTTP/1.1 200 OK\r\n";
+    response += "Access-Control-Allow-Origin: *\r\n";
+    response += "Access-Control-Allow-Methods: POST, GET, OPTIONS\r\n";
+    response += "Access-Control-Allow-Headers: Content-Type\r\n";
+    response += "Content-Length: 0\r\n\r\n";
+    return response;
+}
+
+// Prometheus 文本格式的运行指标，附带结果缓存的统计
+HttpResponse serveMetrics(const HttpRequest&) {
+    stringstream out;
+    metrics.writePrometheus(out);
+    const string& p = metrics.metricPrefix();
+    ResultCache::Stats cache = resultCache.stats();
+    size_t queued = workerPool ? workerPool->queued() : 0;
+    {
+        lock_guard<mutex> lock(shardsMtx);
+        for (ServerShard* shard : runningShards) {
+            ResultCache::Stats part = shard->results.stats();
+            cache.hits += part.hits;
+            cache.misses += part.misses;
+            cache.evictions += part.evictions;
+            cache.entries += part.entries;
+            cache.bytes += part.bytes;
+            cache.capacity += part.capacity;
+            queued += shard->pool->queued();
+        }
+    }
+    out << "# HELP " << p << "result_cache_hits_total Analysis results served from the cache.\n";
+    out << "# TYPE " << p << "result_cache_hits_total counter\n";
+    out << p << "result_cache_hits_total " << cache.hits << "\n";
+    out << "# HELP " << p << "result_cache_misses_total Analysis results that had to be computed.\n";
+    out << "# TYPE " << p << "result_cache_misses_total counter\n";
+    out << p << "result_cache_misses_total " << cache.misses << "\n";
+    out << "# HELP " << p << "result_cache_evictions_total Entries evicted to stay within the byte budget.\n";
+    out << "# TYPE " << p << "result_cache_evictions_total counter\n";
+    out << p << "result_cache_evictions_total " << cache.evictions << "\n";
+    out << "# HELP " << p << "result_cache_entries Entries in the result cache.\n";
+    out << "# TYPE " << p << "result_cache_entries gauge\n";
+    out << p << "result_cache_entries " << cache.entries << "\n";
+    out << "# HELP " << p << "result_cache_bytes Bytes held by the result cache.\n";
+    out << "# TYPE " << p << "result_cache_bytes gauge\n";
+    out << p << "result_cache_bytes " << cache.bytes << "\n";
+    out << "# HELP " << p << "result_cache_capacity_bytes Byte budget of the result cache.\n";
+    out << "# TYPE " << p << "result_cache_capacity_bytes gauge\n";
+    out << p << "result_cache_capacity_bytes " << cache.capacity << "\n";
+    out << "# HELP " << p << "queued_requests Requests waiting for a worker thread.\n";
+    out << "# TYPE " << p << "queued_requests gauge\n";
+    out << p << "queued_requests " << queued << "\n";
+
+    string body = out.str();
+    HttpResponse response;
+    response.head = "HTTP/1.1 200 OK\r\n";
+    response.head += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    response.head += "Cache-Control: no-store\r\n";
+    response.head += "Content-Length: " + to_string(body.size()) + "\r\n\r\n";
+    response.body = move(body);
+    return response;
+}
+
+typedef function<HttpResponse(const HttpRequest&)> RouteHandler;
+
+// 路由表：方法 + 路径 → 处理函数
+const unordered_map<string, RouteHandler> routes = {
+    {"POST /analyze", [](const HttpRequest& req) { return analysisEndpoint(req, "analyze"); }},
+    {"POST /llparse", [](const HttpRequest& req) { return analysisEndpoint(req, "llparse"); }},
+    {"POST /lrparse", [](const HttpRequest& req) { return analysisEndpoint(req, "lrparse"); }},
+    {"POST /translate", [](const HttpRequest& req) { return analysisEndpoint(req, "translate"); }},
+    {"POST /batch", batchEndpoint},
+    {"GET /metrics", serveMetrics},
+    {"GET /ws", webSocketOnly},
+};
+
+// 处理一个完整的HTTP请求，返回响应（与套接字无关，可在任意线程调用）
+HttpResponse handleRequest(const HttpRequest& req) {
+    auto route = routes.find(req.method + " " + req.path);
+    if (route != routes.end()) return route->second(req);
+    if (req.method == "OPTIONS") return corsPreflight(req);
+    if (req.method == "GET") return serveStatic(req);
+    return textResponse("404 Not Found", "No route for " + req.method + " " + req.path + "\n");
+}
+
+// 请求无法解析或超出大小限制时的响应，之后连接将被关闭
+HttpResponse parseErrorResponse(const HttpRequestParser& parser) {
+    string status;
+    switch (parser.errorStatus()) {
+        case 413: status = "413 Payload Too Large"; break;
+        case 431: status = "431 Request Header Fields Too Large"; break;
+        case 501: status = "501 Not Implemented"; break;
+        case 505: status = "505 HTTP Version Not Supported"; break;
+        default: status = "400 Bad Request"; break;
+    }
+    return textResponse(status, parser.errorMessage() + "\n");
+}
+
+// 按HTTP/1.1语义判断请求是否希望保持连接
+bool wantsKeepAlive(const HttpRequest& req) {
+    string conn = req.header("Connection");
+    for (auto& ch : conn) ch = tolower((unsigned char)ch);
+    if (conn.find("close") != string::npos) return false;
+    if (conn.find("keep-alive") != string::npos) return true;
+    return req.version != "HTTP/1.0";
+}
+
+
+// 在状态行之后加入连接管理相关的响应头
+void addConnectionHeaders(HttpResponse& response, bool keepAlive, const ServerConfig& config) {
+    insertHeaders(response, keepAlive
+        ? "Connection: keep-alive\r\nKeep-Alive: timeout=" + to_string(config.keepAliveTimeout) +
+          ", max=" + to_string(config.maxRequestsPerConnection) + "\r\n"
+        : "Connection: close\r\n");
+}
+
+#ifndef _WIN32
+// 阻塞方式下套接字暂时写不下时，等它变为可写
+bool waitWritable(int fd) {
+    pollfd p{fd, POLLOUT, 0};
+    int n;
+    do {
+        n = poll(&p, 1, -1);
+    } while (n < 0 && errno == EINTR);
+    return n > 0 && !(p.revents & (POLLERR | POLLHUP | POLLNVAL));
+}
+#endif
+
+// 阻塞方式把几段内存（最多8段）依次完整写出。一次 writev 提交全部段，
+// 部分写出时跳过已写完的段、从断点继续；被信号打断时重试，暂时写不下（EAGAIN）时等待可写
+bool sendPieces(int fd, const string_view* pieces, int count) {
+#ifdef _WIN32
+    for (int i = 0; i < count; ++i) {
+        const char* data = pieces[i].data();
+        size_t len = pieces[i].size();
+        while (len > 0) {
+            int n = send(fd, data, (int)len, 0);
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+    }
+    return true;
+#else
+    iovec iov[8];
+    int n = 0;
+    for (int i = 0; i < count && n < 8; ++i) {
+        if (pieces[i].empty()) continue;
+        iov[n].iov_base = (void*)pieces[i].data();
+        iov[n++].iov_len = pieces[i].size();
+    }
+    int first = 0;
+    while (first < n) {
+        ssize_t sent = writev(fd, iov + first, n - first);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(fd)) continue;
+            return false;
+        }
+        for (; first < n && (size_t)sent >= iov[first].iov_len; ++first) sent -= iov[first].iov_len;
+        if (first < n) {
+            iov[first].iov_base = (char*)iov[first].iov_base + sent;
+            iov[first].iov_len -= sent;
+        }
+    }
+    return true;
+#endif
+}
+
+bool sendAll(int fd, const char* data, size_t len) {
+    string_view piece(data, len);
+    return sendPieces(fd, &piece, 1);
+}
+
+// 阻塞方式发送完整响应：内存部分一次 writev，文件部分 sendfile
+bool sendResponse(int fd, const HttpResponse& response) {
+    string_view parts[4] = {response.head, response.body, response.shared, response.tail};
+    if (!sendPieces(fd, parts, 4)) return false;
+#ifdef __linux__
+    off_t offset = response.fileOffset;
+    off_t fileEnd = response.fileOffset + response.fileLength;
+    while (offset < fileEnd) {
+        ssize_t n = sendfile(fd, response.fileFd, &offset, fileEnd - offset);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(fd)) continue;
+        return false;
+    }
+#endif
+    return true;
+}
+
+// 流式响应每个分块的大小，事件循环中每个响应在内存里排队等待写出的字节数，
+// 以及超出后暂存到临时文件的字节数上限：单个响应和整个进程各有一个，超出任一个则中止该响应
+const size_t STREAM_CHUNK_BYTES = 16 * 1024;
+const size_t STREAM_QUEUE_BYTES = 64 * 1024;
+const size_t STREAM_SPILL_BYTES = 256 * 1024 * 1024;
+const size_t STREAM_SPILL_TOTAL_BYTES = 1024 * 1024 * 1024;
+SpillBudget streamSpillBudget(STREAM_SPILL_TOTAL_BYTES);
+
+// 流式响应的发送端
+class ResponseSink {
+public:
+    virtual ~ResponseSink() {}
+    // 交出响应头（正文较小时连同整个正文）；more 表示之后还有分块
+    virtual bool begin(HttpResponse&& response, bool more) = 0;
+    // 交出一段已分块编码的正文
+    virtual bool write(string&& data) = 0;
+    // 正文结束；ok 为 false 表示中途失败，连接不能再复用
+    virtual void end(bool ok) = 0;
+};
+
+// 运行 response.produce 并把结果交给 sink：正文不足一个分块时整体以Content-Length发送，
+// 否则每攒满一个分块就以 Transfer-Encoding: chunked 发出，内存占用与正文总长度无关
+// sent 累计交给 sink 的字节数
+bool sendProduced(HttpResponse response, ResponseSink& sink, size_t& sent) {
+    auto produce = move(response.produce);
+    response.produce = nullptr;
+    ChunkedEncoderBuf encoder(
+        STREAM_CHUNK_BYTES,
+        [&] {
+            // 响应头发出时计算尚未结束，耗时分解放在结尾的 trailer 中
+            if (currentTiming) response.head += "Trailer: Server-Timing\r\n";
+            response.head += "Transfer-Encoding: chunked\r\n\r\n";
+            sent += response.memorySize();
+            return sink.begin(move(response), true);
+        },
+        [&](string&& chunk) {
+            sent += chunk.size();
+            return sink.write(move(chunk));
+        });
+    ostream body(&encoder);
+    try {
+        produce(body);
+    } catch (const BudgetExceeded&) {
+        // 已开始分块发送时无法再改状态码，只能中止连接；否则交给调用方回复错误
+        if (!encoder.streaming()) throw;
+        metrics.overBudgetRequests++;
+        sink.end(false);
+        return false;
+    }
+    if (encoder.streaming()) {
+        bool ok = encoder.finish(currentTiming ? "Server-Timing: " + currentTiming->header() + "\r\n" : "");
+        sink.end(ok);
+        return ok;
+    }
+    // 正文不足一个分块：直接引用编码器的缓冲区，不再复制
+    if (currentTiming && !currentTiming->empty()) response.head += "Server-Timing: " + currentTiming->header() + "\r\n";
+    response.shared = encoder.buffered();
+    response.owner = encoder.releaseBuffer();
+    response.head += "Content-Length: " + to_string(response.shared.size()) + "\r\n\r\n";
+    sent += response.memorySize();
+    return sink.begin(move(response), false);
+}
+
+// 阻塞方式：直接写到套接字
+class SocketSink : public ResponseSink {
+    int fd;
+
+public:
+    explicit SocketSink(int f) : fd(f) {}
+    bool begin(HttpResponse&& response, bool) override { return sendResponse(fd, response); }
+    bool write(string&& data) override { return sendAll(fd, data.data(), data.size()); }
+    void end(bool) override {}
+};
+
+// 指标中请求所属的接口：路由表中的路径、静态文件或其他
+string metricsLabel(const HttpRequest& req) {
+    if (routes.count(req.method + " " + req.path)) return req.path;
+    if (req.method == "GET") return "static";
+    return "other";
+}
+
+// 处理一个请求并把响应交给 sink，同时记录该接口的指标。
+// 耗时从开始处理计到正文全部生成（流式响应即最后一个分块交出）为止。
+// 分析超出时间预算时回复503；若正文已开始分块发送则中止连接
+bool serveRequest(const HttpRequest& req, bool keepAlive, const ServerConfig& config, ResponseSink& sink) {
+    EndpointMetrics& m = metrics.endpoint(metricsLabel(req));
+    m.inFlight++;
+    auto start = chrono::steady_clock::now();
+    RequestTiming timing;  // 各处理阶段的耗时，经 Server-Timing 返回
+    RequestBudget budget(config.requestTimeoutMs, config.requestCpuMs);
+    currentTiming = &timing;
+    currentBudget = &budget;
+
+    int status = 0;
+    size_t sent = 0;
+    bool ok;
+    try {
+        HttpResponse response = handleRequest(req);
+        addConnectionHeaders(response, keepAlive, config);
+        status = atoi(response.head.c_str() + 9);  // "HTTP/1.1 200 OK"
+        if (response.produce) {
+            ok = sendProduced(move(response), sink, sent);
+        } else {
+            if (!timing.empty()) insertHeaders(response, "Server-Timing: " + timing.header() + "\r\n");
+            sent = response.memorySize() + response.fileLength;
+            ok = sink.begin(move(response), false);
+        }
+    } catch (const BudgetExceeded& e) {
+        // 只会在任何字节发出之前到达这里
+        metrics.overBudgetRequests++;
+        HttpResponse response = textResponse("503 Service Unavailable", string(e.what()) + "\n");
+        addConnectionHeaders(response, keepAlive, config);
+        status = 503;
+        sent = response.memorySize();
+        ok = sink.begin(move(response), false);
+    }
+    currentTiming = nullptr;
+    currentBudget = nullptr;
+
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    m.finish(status, req.wireBytes, sent, elapsed.count());
+    m.inFlight--;
+    return ok;
+}
+
+// 阻塞方式的WebSocket会话：在本线程内依次处理消息，每次收到的数据全部处理完后才分析一次，
+// 因此连续到达的修改会合并。pending 是握手请求之后已经读到的字节
+void serveWebSocket(int fd, const HttpRequest& req, string pending, const ServerConfig& config) {
+    bool accepted;
+    HttpResponse response = webSocketHandshake(req, accepted);
+    if (!accepted) addConnectionHeaders(response, false, config);
+    metrics.endpoint(metricsLabel(req)).finish(accepted ? 101 : atoi(response.head.c_str() + 9), req.wireBytes,
+                                               response.memorySize(), 0);
+    if (!sendResponse(fd, response) || !accepted) return;
+
+#ifdef _WIN32
+    DWORD timeout = config.webSocketIdleTimeout * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+#else
+    timeval timeout{config.webSocketIdleTimeout, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+    WebSocketParser parser(config.maxBodyBytes);
+    DocumentSession session(config.maxBodyBytes);
+    char buffer[8192];
+    bool closing = false;
+    while (!closing) {
+        if (pending.empty()) {
+            int n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) return;
+            pending.assign(buffer, n);
+        }
+        bool changed = false;
+        size_t offset = 0;
+        while (offset < pending.size() && !closing) {
+            offset += parser.feed(pending.data() + offset, pending.size() - offset);
+            if (parser.status() == WebSocketParser::Failed) {
+                string frame = webSocketCloseFrame(parser.errorStatus(), parser.errorMessage());
+                sendAll(fd, frame.data(), frame.size());
+                return;
+            }
+            if (parser.status() == WebSocketParser::Complete) {
+                string payload;
+                int opcode = parser.take(payload);
+                vector<string> replies;
+                if (handleWebSocketMessage(session, opcode, payload, replies, closing)) changed = true;
+                for (auto& frame : replies) {
+                    if (!sendAll(fd, frame.data(), frame.size())) return;
+                }
+            }
+        }
+        pending.clear();
+        if (changed && !closing) {
+            bool ok = true;
+            analyzeDocument(session.code, session.version, session.stages, config, [&](HttpResponse&& frame) {
+                if (ok) ok = sendResponse(fd, frame);
+            });
+            if (!ok) return;
+        }
+    }
+}
+
+// 处理单个客户端连接（阻塞方式）：循环读取请求并按序写回，支持keep-alive与流水线
+void handleClient(int client_fd, const ServerConfig& config) {
+#ifdef _WIN32
+    DWORD timeout = config.keepAliveTimeout * 1000;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+#else
+    timeval timeout{config.keepAliveTimeout, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+    metrics.openConnections++;
+    HttpRequestParser parser(config.maxHeaderBytes, config.maxBodyBytes);
+    char buffer[8192];
+    size_t pending = 0, offset = 0;  // buffer 中尚未交给解析器的字节
+    int served = 0;
+    bool keepAlive = true;
+    while (keepAlive) {
+        while (parser.status() == HttpRequestParser::NeedMore) {
+            if (offset == pending) {
+                int n = recv(client_fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {  // 对端关闭或空闲超时
+                    metrics.openConnections--;
+                    closeSocket(client_fd);
+                    return;
+                }
+                pending = n;
+                offset = 0;
+            }
+            offset += parser.feed(buffer + offset, pending - offset);
+        }
+        if (parser.status() == HttpRequestParser::Failed) {
+            metrics.rejectedRequests++;
+            HttpResponse response = parseErrorResponse(parser);
+            addConnectionHeaders(response, false, config);
+            sendResponse(client_fd, response);
+            break;
+        }
+        HttpRequest req = parser.take();
+        if (isWebSocketUpgrade(req)) {
+            serveWebSocket(client_fd, req, string(buffer + offset, pending - offset), config);
+            break;
+        }
+
+        keepAlive = wantsKeepAlive(req) && ++served < config.maxRequestsPerConnection;
+        SocketSink sink(client_fd);
+        if (!serveRequest(req, keepAlive, config, sink)) break;
+    }
+    
+    metrics.openConnections--;
+    closeSocket(client_fd);
+}
+
+#ifdef __linux__
+// 设置非阻塞模式
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 升级为WebSocket之后连接上的状态
+struct WebSocketState {
+    WebSocketParser parser;
+    DocumentSession session;
+    bool analyzing = false;      // 线程池中正在分析文档的某个版本
+    bool stale = false;          // 文档在最近一次分析之后又有修改
+    uint64_t lastResultSeq = 0;  // 正在进行的分析中最后一个结果帧的序号
+
+    explicit WebSocketState(size_t maxBytes) : parser(maxBytes), session(maxBytes) {}
+};
+
+// 事件循环中的一个客户端连接
+struct Connection {
+    int fd;
+    HttpRequestParser parser;  // 正在接收的请求
+    string in;              // 流水线已满时暂存的后续字节
+    HttpResponse out;       // 正在发送的响应
+    size_t outOffset = 0;   // out 的内存部分（head/body/shared）已发送的字节数
+    size_t fileSent = 0;    // out 的文件部分已发送的字节数
+    bool writing = false;   // out 尚未发送完
+    bool corked = false;
+    uint64_t nextSeq = 0;   // 下一个分派请求的序号
+    uint64_t writeSeq = 0;  // 下一个应写出的响应序号
+    map<uint64_t, HttpResponse> ready;  // 已完成但尚未轮到写出的响应（流水线按序应答）
+    int inFlight = 0;       // 正在工作线程中处理的请求数
+    int served = 0;         // 本连接已接收的请求数
+    bool draining = false;  // 不再接收新请求，写完已接收请求的响应后关闭
+    bool peerClosed = false;// 对端已关闭写方向
+    bool closed = false;
+    uint64_t id = 0;        // io_uring后端中完成事件据此找到连接
+    time_t lastActive;
+    unique_ptr<WebSocketState> ws;  // 非空时连接已升级为WebSocket，收到的字节按帧解析
+    Waiter readable;        // 读协程在此等待套接字可读（epoll后端）
+    Waiter writable;        // 写协程在此等待可以继续写（epoll为可写，io_uring为发送完成）
+    bool writerActive = false;  // 写协程正在运行或挂起等待
+    bool writeBlocked = false;  // 写协程因套接字写不下而挂起
+    bool readPaused = false;    // 积压过多，暂停从套接字读取
+
+    Connection(int f, const ServerConfig& config)
+        : fd(f), parser(config.maxHeaderBytes, config.maxBodyBytes), lastActive(time(nullptr)) {}
+
+    bool idle() const { return inFlight == 0 && ready.empty() && !writing; }
+};
+
+// 事件循环：单线程负责所有套接字的读写，连接的解析、流水线与响应排序在这里，
+// 套接字上的具体操作由epoll或io_uring后端实现。
+// 每个请求由一个协程处理：co_await toPool() 切到线程池做分析，co_await toLoop()
+// 回到事件循环交付响应，因此连接上的I/O从不占用工作线程，分析也从不阻塞事件循环。
+// 每个连接的写协程写不下时挂起，等后端通知后继续（epoll后端的读协程也是如此）
+class EventServer {
+protected:
+    // 每个连接同时交给线程池处理的流水线请求上限
+    static const int MAX_PIPELINE = 16;
+    // 每个连接暂存的未解析字节加上已完成、尚未写出的响应超过此值时暂停读取，
+    // 不读响应却不停发送请求的客户端不会让内存无限增长
+    static const size_t MAX_BACKLOG_BYTES = 1024 * 1024;
+
+    int listenFd;
+    int wakeFd = -1;
+    ThreadPool& pool;
+    const ServerConfig& config;
+    unordered_map<int, shared_ptr<Connection>> conns;
+
+    mutex postedMtx;
+    vector<function<void()>> posted;  // 其他线程交给事件循环执行的操作
+
+    // 任意线程：让事件循环执行 f
+    void post(function<void()> f) {
+        {
+            lock_guard<mutex> lock(postedMtx);
+            posted.push_back(move(f));
+        }
+        wakeLoop();
+    }
+
+    void wakeLoop() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // co_await toPool()：之后的代码在工作线程中执行；线程池队列已满时留在事件循环，结果为false
+    auto toPool() {
+        return Reschedule([this](function<void()> resume) { return pool.trySubmit(move(resume)); });
+    }
+
+    // co_await toLoop()：之后的代码回到事件循环中执行
+    auto toLoop() {
+        return Reschedule([this](function<void()> resume) {
+            post(move(resume));
+            return true;
+        });
+    }
+
+    // 工作线程中的响应出口。完整的响应先留在这里，由请求协程回到事件循环后交付；
+    // 流式响应要在正文生成期间就开始写出，所以响应头立即交给事件循环，分块经队列送达。
+    // 生产者从不等待客户端：内存中排队的分块超过上限后写入临时文件，由事件循环用sendfile发出，
+    // 客户端读得慢只占磁盘（通常是页缓存），不占工作线程
+    class StreamSink : public ResponseSink {
+        EventServer& server;
+        shared_ptr<Connection> conn;
+        uint64_t seq;
+        shared_ptr<ChunkQueue> queue;
+
+    public:
+        HttpResponse response;  // 尚未交付的完整响应
+        bool held = false;
+
+        StreamSink(EventServer& s, const shared_ptr<Connection>& c, uint64_t q) : server(s), conn(c), seq(q) {}
+
+        bool begin(HttpResponse&& r, bool more) override {
+            if (!more) {
+                response = move(r);
+                held = true;
+                return true;
+            }
+            EventServer* srv = &server;
+            weak_ptr<Connection> weak = conn;
+            queue = make_shared<ChunkQueue>(STREAM_QUEUE_BYTES, STREAM_SPILL_BYTES, [srv, weak] {
+                srv->post([srv, weak] {
+                    if (auto target = weak.lock()) srv->onStreamReady(target);
+                });
+            }, &streamSpillBudget);
+            r.stream = queue;
+            server.post([srv, c = conn, q = seq, r = move(r)]() mutable { srv->deliver(c, q, move(r)); });
+            return true;
+        }
+
+        bool write(string&& data) override {
+            return queue->push(move(data));
+        }
+
+        void end(bool ok) override {
+            if (ok) queue->finish();
+            else queue->cancel();
+        }
+    };
+
+    // 后端接受新连接后登记
+    shared_ptr<Connection> addConnection(int fd) {
+        auto c = make_shared<Connection>(fd, config);
+        conns[fd] = c;
+        metrics.openConnections++;
+        return c;
+    }
+
+    // 后端相关：注销并关闭连接的套接字
+    virtual void release(const shared_ptr<Connection>& c) = 0;
+    // 后端相关：写出内存部分或文件部分，返回写出的字节数；
+    // 返回-1且errno为EAGAIN表示暂时写不了，写协程挂起，后端就绪时唤醒 c.writable
+    // 后端相关：暂停读取后恢复（epoll重新启动读协程，io_uring重新提交接收）
+    virtual void startReading(const shared_ptr<Connection>& c) = 0;
+    virtual ssize_t sendMemory(Connection& c, const iovec* iov, int count) = 0;
+    virtual ssize_t sendFile(Connection& c, const HttpResponse& r) = 0;
+    // 后端相关：开始发送新的文件部分，之前为文件部分缓存的内容不再有效
+    virtual void fileStarting(Connection&) {}
+
+    void closeConn(const shared_ptr<Connection>& c) {
+        if (c->closed) return;
+        c->closed = true;
+        metrics.openConnections--;
+        // 让仍在生成流式正文的工作线程停下
+        if (c->out.stream) c->out.stream->cancel();
+        for (auto& r : c->ready) {
+            if (r.second.stream) r.second.stream->cancel();
+        }
+        // 挂起的读写协程醒来后看到连接已关闭，随即结束
+        c->readable.wake();
+        c->writable.wake();
+        release(c);
+        conns.erase(c->fd);
+    }
+
+    // 流水线已满（处理中的请求加上未写出的响应），或暂存的字节与待写出的响应太多：
+    // 此时不再解析新请求，后端也停止读取。流式响应按其队列在内存中最多占用的字节计
+    bool backlogged(const Connection& c) const {
+        if (c.inFlight + c.ready.size() >= (size_t)MAX_PIPELINE) return true;
+        size_t bytes = c.in.size();
+        for (const auto& r : c.ready) bytes += r.second.memorySize() + (r.second.stream ? STREAM_QUEUE_BYTES : 0);
+        return bytes > MAX_BACKLOG_BYTES;
+    }
+
+    // 把收到的字节直接交给增量解析器，每解析出一个完整请求就交给线程池（流水线）；
+    // 积压时暂存剩余字节（至多一次读取的量，之后后端暂停读取），等请求完成、响应写出后再继续
+    void consume(const shared_ptr<Connection>& c, const char* data, size_t len) {
+        while (len > 0 && !c->draining && !c->closed) {
+            if (c->ws) {
+                consumeWebSocket(c, data, len);
+                return;
+            }
+            if (backlogged(*c)) {
+                c->in.append(data, len);
+                return;
+            }
+            size_t used = c->parser.feed(data, len);
+            data += used;
+            len -= used;
+
+            if (c->parser.status() == HttpRequestParser::Failed) {
+                // 出错后无法确定下一个请求的起点，回复错误后关闭连接
+                metrics.rejectedRequests++;
+                HttpResponse response = parseErrorResponse(c->parser);
+                addConnectionHeaders(response, false, config);
+                c->draining = true;
+                c->in.clear();
+                c->ready[c->nextSeq++] = move(response);
+                flush(c);
+                return;
+            }
+            if (c->parser.status() == HttpRequestParser::Complete) {
+                HttpRequest req = c->parser.take();
+                if (isWebSocketUpgrade(req)) upgrade(c, req);
+                else dispatch(c, move(req));
+            }
+        }
+    }
+
+    // 升级为WebSocket：101响应按序写出，其后的字节都按帧解析
+    void upgrade(const shared_ptr<Connection>& c, const HttpRequest& req) {
+        bool accepted;
+        HttpResponse response = webSocketHandshake(req, accepted);
+        if (accepted) {
+            c->ws.reset(new WebSocketState(config.maxBodyBytes));
+        } else {
+            addConnectionHeaders(response, false, config);
+            c->draining = true;
+            c->in.clear();
+        }
+        metrics.endpoint(metricsLabel(req)).finish(accepted ? 101 : atoi(response.head.c_str() + 9), req.wireBytes,
+                                                   response.memorySize(), 0);
+        c->ready[c->nextSeq++] = move(response);
+        flush(c);
+    }
+
+    // WebSocket帧：控制帧和错误直接在事件循环中回复，文档被修改后标记为待分析
+    void consumeWebSocket(const shared_ptr<Connection>& c, const char* data, size_t len) {
+        WebSocketState& ws = *c->ws;
+        while (len > 0 && !c->draining) {
+            size_t used = ws.parser.feed(data, len);
+            data += used;
+            len -= used;
+            if (ws.parser.status() == WebSocketParser::Failed) {
+                c->ready[c->nextSeq++] = HttpResponse(webSocketCloseFrame(ws.parser.errorStatus(), ws.parser.errorMessage()));
+                c->draining = true;
+                break;
+            }
+            if (ws.parser.status() == WebSocketParser::Complete) {
+                string payload;
+                int opcode = ws.parser.take(payload);
+                vector<string> replies;
+                bool closing = false;
+                if (handleWebSocketMessage(ws.session, opcode, payload, replies, closing)) ws.stale = true;
+                for (auto& frame : replies) c->ready[c->nextSeq++] = HttpResponse(move(frame));
+                if (closing) c->draining = true;
+            }
+        }
+        flush(c);
+    }
+
+    // 文档有未分析的修改、上一次分析已结束且输出都已写出时，开始分析最新版本。
+    // 分析期间到达的修改合并到下一次；客户端读得慢时也不会积压多个版本的结果
+    void maybeAnalyze(const shared_ptr<Connection>& c) {
+        if (!c->ws || c->closed || c->draining) return;
+        WebSocketState& ws = *c->ws;
+        if (!ws.stale || ws.analyzing || c->writing || !c->ready.empty()) return;
+        if (ws.session.stages.empty()) {
+            ws.stale = false;
+            return;
+        }
+        analyze(c);
+    }
+
+    // 分析文档的协程：在事件循环中取下文档快照、为各阶段的结果帧预留序号，
+    // 在线程池中分析，每得到一个阶段的结果就交回事件循环写出
+    Task analyze(shared_ptr<Connection> c) {
+        WebSocketState& ws = *c->ws;
+        string code = ws.session.code;
+        long long version = ws.session.version;
+        vector<string> stages = ws.session.stages;
+        uint64_t first = c->nextSeq;
+        ws.analyzing = true;
+        ws.stale = false;
+        ws.lastResultSeq = first + stages.size() - 1;
+        c->nextSeq += stages.size();
+        c->inFlight += stages.size();
+        if (!co_await toPool()) {
+            // 线程池已满：撤销预留，保持待分析状态，由每秒一次的巡检重试
+            metrics.shedRequests++;
+            ws.analyzing = false;
+            ws.stale = true;
+            c->nextSeq = first;
+            c->inFlight -= stages.size();
+            co_return;
+        }
+        uint64_t seq = first;
+        analyzeDocument(code, version, stages, config, [&](HttpResponse&& frame) {
+            post([this, c, s = seq++, f = move(frame)]() mutable { deliver(c, s, move(f)); });
+        });
+    }
+
+    // 把一个完整的请求交给请求协程，结果按序号写回
+    void dispatch(const shared_ptr<Connection>& c, HttpRequest&& req) {
+        bool keepAlive = wantsKeepAlive(req) && ++c->served < config.maxRequestsPerConnection;
+        if (!keepAlive) {
+            c->draining = true;
+            c->in.clear();
+        }
+        uint64_t seq = c->nextSeq++;
+        c->inFlight++;
+        process(c, seq, move(req), keepAlive);
+    }
+
+    // 一个HTTP请求的处理过程，从事件循环中开始
+    Task process(shared_ptr<Connection> c, uint64_t seq, HttpRequest req, bool keepAlive) {
+        if (!co_await toPool()) {
+            // 线程池队列已满：直接在事件循环中回复503，不让排队时间无限增长
+            c->inFlight--;
+            metrics.shedRequests++;
+            HttpResponse response = overloadedResponse();
+            addConnectionHeaders(response, keepAlive, config);
+            metrics.endpoint(metricsLabel(req)).finish(503, req.wireBytes, response.memorySize(), 0);
+            c->ready[seq] = move(response);
+            flush(c);
+            co_return;
+        }
+        StreamSink sink(*this, c, seq);
+        serveRequest(req, keepAlive, config, sink);
+        if (!sink.held) co_return;  // 流式响应，已在开始时交付
+        co_await toLoop();
+        deliver(c, seq, move(sink.response));
+    }
+
+    // 积压消除后（请求完成或响应写出），继续解析暂存的字节，并恢复读取
+    void resume(const shared_ptr<Connection>& c) {
+        if (!c->in.empty() && !backlogged(*c)) {
+            string pending;
+            pending.swap(c->in);
+            consume(c, pending.data(), pending.size());
+        }
+        if (!c->closed && c->readPaused && !backlogged(*c)) {
+            c->readPaused = false;
+            startReading(c);
+        }
+        if (!c->closed && c->peerClosed && c->idle()) closeConn(c);
+    }
+
+    // 事件循环：交付一个请求（或一帧分析结果）的响应，按序写出
+    void deliver(const shared_ptr<Connection>& c, uint64_t seq, HttpResponse&& response) {
+        c->inFlight--;
+        if (c->closed) {
+            if (response.stream) response.stream->cancel();
+            return;
+        }
+        if (c->ws && c->ws->analyzing && seq == c->ws->lastResultSeq) c->ws->analyzing = false;
+        c->ready[seq] = move(response);
+        flush(c);
+        if (!c->closed) resume(c);
+    }
+
+    // 流式响应有新分块，或生产者已放弃
+    void onStreamReady(const shared_ptr<Connection>& c) {
+        if (c->closed) return;
+        // 生产者放弃时可能正卡在写某个分块的中途，直接关闭
+        if (c->writing && c->out.stream && c->out.stream->isCancelled()) closeConn(c);
+        else flush(c);
+    }
+
+    // 执行其他线程交给事件循环的操作：请求协程的后半段、分析结果、流式分块的通知
+    void runPosted() {
+        uint64_t count;
+        while (read(wakeFd, &count, sizeof(count)) > 0) {}
+
+        vector<function<void()>> tasks;
+        {
+            lock_guard<mutex> lock(postedMtx);
+            tasks.swap(posted);
+        }
+        for (auto& task : tasks) task();
+    }
+
+    // 按序号依次写出已就绪的响应。写协程没在运行时启动一个；
+    // 正在运行或挂起等待时，它写完当前响应后自己会取到新的响应
+    void flush(const shared_ptr<Connection>& c) {
+        if (!c->closed && !c->writerActive) writeResponses(c);
+    }
+
+    // 写协程：写不下时挂起，等后端通知可以继续；没有可写的内容时结束。
+    // 内存部分（head/body/shared）一次写出，之后是文件部分，期间 TCP_CORK 合并成满包
+    Task writeResponses(shared_ptr<Connection> c) {
+        c->writerActive = true;
+        while (!c->closed) {
+            if (!c->writing) {
+                auto next = c->ready.find(c->writeSeq);
+                if (next == c->ready.end()) break;
+                c->out = move(next->second);
+                c->ready.erase(next);
+                c->writeSeq++;
+                c->outOffset = 0;
+                c->fileSent = 0;
+                c->writing = true;
+                if (c->out.fileFd >= 0) fileStarting(*c);
+                if (c->out.fileFd >= 0 && !c->corked) setCork(c, true);
+            }
+
+            HttpResponse& r = c->out;
+            ssize_t n;
+            if (c->outOffset < r.memorySize()) {
+                string_view parts[4] = {r.head, r.body, r.shared, r.tail};
+                iovec iov[4];
+                int cnt = 0;
+                size_t skip = c->outOffset;
+                for (auto& part : parts) {
+                    if (skip >= part.size()) {
+                        skip -= part.size();
+                        continue;
+                    }
+                    iov[cnt].iov_base = (void*)(part.data() + skip);
+                    iov[cnt++].iov_len = part.size() - skip;
+                    skip = 0;
+                }
+                n = sendMemory(*c, iov, cnt);
+                if (n > 0) c->outOffset += n;
+            } else if (c->fileSent < r.fileLength) {
+                n = sendFile(*c, r);
+                if (n == 0) {  // 文件在发送途中被截断，无法再按Content-Length完成响应
+                    closeConn(c);
+                    break;
+                }
+                if (n > 0) c->fileSent += n;
+            } else if (r.stream) {
+                // 流式正文：取下一个分块作为新的内存部分（或暂存文件中的一段作为文件部分）继续写；
+                // 暂无分块时等生产者唤醒
+                string chunk;
+                size_t spillOffset = 0, spillLength = 0;
+                ChunkQueue::Take taken = r.stream->take(chunk, spillOffset, spillLength);
+                if (taken == ChunkQueue::Empty) {  // 生产者放入分块后会再次 flush
+                    c->writerActive = false;
+                    co_return;
+                }
+                if (taken == ChunkQueue::Cancelled) {  // 响应已无法完整发出
+                    closeConn(c);
+                    break;
+                }
+                if (taken == ChunkQueue::Data || taken == ChunkQueue::Spilled) {
+                    r.head.clear();
+                    r.body = move(chunk);
+                    r.shared = string_view();
+                    r.tail.clear();
+                    c->outOffset = 0;
+                    r.fileFd = taken == ChunkQueue::Spilled ? r.stream->fileDescriptor() : -1;
+                    r.fileOffset = spillOffset;
+                    r.fileLength = spillLength;
+                    c->fileSent = 0;
+                    if (taken == ChunkQueue::Spilled) fileStarting(*c);
+                    continue;
+                }
+                r.stream.reset();
+                continue;
+            } else {
+                c->writing = false;
+                c->out = HttpResponse();
+                if (c->corked) setCork(c, false);
+                continue;
+            }
+
+            if (n > 0) {
+                c->lastActive = time(nullptr);
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                c->writeBlocked = true;
+                co_await c->writable;
+                c->writeBlocked = false;
+            } else {
+                closeConn(c);
+                break;
+            }
+        }
+        c->writerActive = false;
+        if (!c->closed && (c->readPaused || !c->in.empty())) resume(c);  // 积压的响应已写完
+        if (!c->closed && c->draining && c->writeSeq == c->nextSeq && c->idle()) {
+            // 先只关闭写方向，等对端关闭（或空闲超时）后再释放连接：
+            // 若对端仍有未读的数据（如被拒绝的请求体），直接close会发送RST并冲掉已写出的响应
+            if (c->peerClosed) closeConn(c);
+            else shutdown(c->fd, SHUT_WR);
+        }
+        maybeAnalyze(c);
+    }
+
+    void setCork(const shared_ptr<Connection>& c, bool on) {
+        int value = on ? 1 : 0;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+        c->corked = on;
+    }
+
+    bool createWakeFd() {
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return wakeFd >= 0;
+    }
+
+    // 关闭超过空闲时间且没有未完成请求的连接（WebSocket连接的空闲时间另行配置），
+    // 以及写不出去、超过空闲时间仍无进展的连接（客户端不读响应）；
+    // 顺便重试因线程池已满而推迟的文档分析
+    void closeIdle() {
+        time_t now = time(nullptr);
+        vector<shared_ptr<Connection>> expired;
+        for (auto& entry : conns) {
+            auto& c = entry.second;
+            int timeout = c->ws ? config.webSocketIdleTimeout : config.keepAliveTimeout;
+            bool stalled = c->writeBlocked && now - c->lastActive >= config.keepAliveTimeout;
+            if ((c->idle() && now - c->lastActive >= timeout) || stalled) expired.push_back(c);
+            else maybeAnalyze(c);
+        }
+        for (auto& c : expired) closeConn(c);
+    }
+
+public:
+    EventServer(int fd, ThreadPool& p, const ServerConfig& cfg) : listenFd(fd), pool(p), config(cfg) {}
+    virtual ~EventServer() {}
+};
+
+// epoll（边沿触发）后端：非阻塞套接字，可读、可写事件分别唤醒连接的读协程和写协程
+class EpollServer : public EventServer {
+    int epfd = -1;
+
+    void watch(int fd, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) cerr << "接受连接失败" << endl;
+                return;
+            }
+            auto c = addConnection(fd);
+            watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+            readRequests(c);
+        }
+    }
+
+    char readBuffer[65536];  // 读协程依次使用，读到的字节在挂起前已处理完
+
+    // 读协程：边沿触发，一直读到EAGAIN后挂起，等下一次可读；
+    // 积压时结束，由 startReading 重新启动（套接字中剩下的数据届时再读）
+    Task readRequests(shared_ptr<Connection> c) {
+        while (!c->closed) {
+            if (backlogged(*c) && !c->draining) {
+                c->readPaused = true;
+                co_return;
+            }
+            ssize_t n = recv(c->fd, readBuffer, sizeof(readBuffer), 0);
+            if (n > 0) {
+                if (c->draining) continue;  // 已决定关闭，丢弃后续数据
+                c->lastActive = time(nullptr);
+                consume(c, readBuffer, n);
+            } else if (n == 0) {
+                c->peerClosed = true;
+                if (c->idle()) closeConn(c);
+                co_return;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await c->readable;
+            } else {
+                closeConn(c);
+                co_return;
+            }
+        }
+    }
+
+    void release(const shared_ptr<Connection>& c) override {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+    }
+
+    void startReading(const shared_ptr<Connection>& c) override { readRequests(c); }
+
+    ssize_t sendMemory(Connection& c, const iovec* iov, int count) override {
+        return writev(c.fd, iov, count);
+    }
+
+    ssize_t sendFile(Connection& c, const HttpResponse& r) override {
+        off_t offset = r.fileOffset + c.fileSent;
+        return sendfile(c.fd, r.fileFd, &offset, r.fileLength - c.fileSent);
+    }
+
+public:
+    EpollServer(int fd, ThreadPool& p, const ServerConfig& cfg) : EventServer(fd, p, cfg) {}
+
+    bool init() {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0 || !createWakeFd() || !setNonBlocking(listenFd)) return false;
+        watch(listenFd, EPOLLIN | EPOLLET);
+        watch(wakeFd, EPOLLIN | EPOLLET);
+        return true;
+    }
+
+    void run() {
+        epoll_event events[256];
+        time_t lastSweep = time(nullptr);
+        while (true) {
+            int n = epoll_wait(epfd, events, 256, 1000);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                cerr << "epoll_wait失败" << endl;
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) { acceptAll(); continue; }
+                if (fd == wakeFd) { runPosted(); continue; }
+
+                auto it = conns.find(fd);
+                if (it == conns.end()) continue;
+                shared_ptr<Connection> c = it->second;
+                uint32_t ev = events[i].events;
+                if (ev & (EPOLLERR | EPOLLHUP)) { closeConn(c); continue; }
+                if (ev & (EPOLLIN | EPOLLRDHUP)) c->readable.wake();
+                if (!c->closed && (ev & EPOLLOUT)) c->writable.wake();
+            }
+            if (time(nullptr) != lastSweep) {
+                lastSweep = time(nullptr);
+                closeIdle();
+            }
+        }
+    }
+};
+
+// io_uring后端：接受连接、接收、发送和关闭都作为异步操作提交，每轮事件循环
+// 只用一次 io_uring_enter 提交本轮产生的全部操作并等待完成事件。
+// 监听套接字上挂一个多次接受（multishot accept），每个连接挂一个多次接收
+// （multishot recv），接收缓冲区取自向内核注册的缓冲区环，用完立即归还。
+// 套接字保持阻塞模式，由内核在就绪时完成操作。收到的数据由完成事件直接送来，
+// 所以这里没有读协程，只有写协程在发送完成前挂起
+class UringServer : public EventServer {
+    // 完成事件的 user_data：高8位是操作类型，其余是连接编号
+    enum Op : uint64_t { OP_ACCEPT = 1, OP_WAKE, OP_TIMER, OP_RECV, OP_SEND, OP_READ_FILE, OP_CLOSE, OP_CANCEL };
+    static const unsigned RING_ENTRIES = 4096;
+    static const unsigned RECV_BUFFERS = 512;      // 必须是2的幂
+    static const size_t RECV_BUFFER_BYTES = 16 * 1024;
+    static const size_t FILE_BUFFER_BYTES = 64 * 1024;
+    static const unsigned short RECV_GROUP = 0;
+
+    // 一个连接在io_uring中的状态。写出操作（发送或读文件）同时最多一个，
+    // 完成后结果暂存并唤醒写协程，由它经 sendMemory/sendFile 取走
+    struct UringConn {
+        shared_ptr<Connection> conn;
+        bool receiving = false;   // 多次接收仍然有效
+        bool cancelling = false;  // 已请求取消接收（积压时暂停读取）
+        int outstanding = 0;      // 已提交、尚未完成的操作数；连接关闭后等它们都完成才释放
+        uint64_t writeOp = 0;     // 正在进行的写出操作，0 表示没有
+        bool writeDone = false;
+        int writeResult = 0;
+        iovec iov[4];
+        vector<char> fileBuffer;  // 文件部分先读到这里再发送
+        size_t fileBufferStart = 0;
+        size_t fileBufferLength = 0;
+    };
+
+    IoUring ring;
+    IoUringBufferRing buffers;
+    unordered_map<uint64_t, UringConn> ioConns;
+    uint64_t nextId = 1;
+    bool multishotAccept = true;  // 内核不支持多次操作时退回每次重新提交
+    bool multishotRecv = true;
+    __kernel_timespec tick{1, 0};
+
+    static uint64_t userData(Op op, uint64_t id) { return (uint64_t)op << 56 | id; }
+
+    io_uring_sqe* prepare(Op op, uint64_t id, uint8_t opcode, int fd) {
+        io_uring_sqe* sqe = ring.sqe();
+        if (!sqe) return nullptr;
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = userData(op, id);
+        return sqe;
+    }
+
+    bool armAccept() {
+        io_uring_sqe* sqe = prepare(OP_ACCEPT, 0, IORING_OP_ACCEPT, listenFd);
+        if (!sqe) return false;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if (multishotAccept) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        return true;
+    }
+
+    bool armWake() {
+        io_uring_sqe* sqe = prepare(OP_WAKE, 0, IORING_OP_POLL_ADD, wakeFd);
+        if (!sqe) return false;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        return true;
+    }
+
+    bool armTimer() {
+        io_uring_sqe* sqe = prepare(OP_TIMER, 0, IORING_OP_TIMEOUT, -1);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)&tick;
+        sqe->len = 1;
+        return true;
+    }
+
+    bool armRecv(uint64_t id, UringConn& u) {
+        io_uring_sqe* sqe = prepare(OP_RECV, id, IORING_OP_RECV, u.conn->fd);
+        if (!sqe) return false;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_GROUP;
+        if (multishotRecv) sqe->ioprio |= IORING_RECV_MULTISHOT;
+        u.receiving = true;
+        u.outstanding++;
+        return true;
+    }
+
+    // 取消连接上的多次接收；取消后接收以 -ECANCELED 结束。取消操作自身的完成事件忽略
+    void cancelRecv(uint64_t id, UringConn& u) {
+        io_uring_sqe* sqe = prepare(OP_CANCEL, id, IORING_OP_ASYNC_CANCEL, -1);
+        if (!sqe) return;  // 提交队列已满：多收到的数据暂存，下一次完成时再试
+        sqe->addr = userData(OP_RECV, id);
+        u.cancelling = true;
+    }
+
+    void startReading(const shared_ptr<Connection>& c) override {
+        UringConn& u = ioConns.at(c->id);
+        // 取消尚未完成时，接收结束的完成事件会重新提交
+        if (!u.receiving && !c->peerClosed && !armRecv(c->id, u)) closeConn(c);
+    }
+
+    // 连接已关闭且没有未完成的操作时，才能释放其缓冲区
+    void forgetIfDone(uint64_t id) {
+        auto it = ioConns.find(id);
+        if (it != ioConns.end() && it->second.conn->closed && it->second.outstanding == 0) ioConns.erase(it);
+    }
+
+    void onAccept(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            if (cqe.res == -EINVAL && multishotAccept) multishotAccept = false;
+            armAccept();
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -EINVAL && cqe.res != -EINTR && cqe.res != -ECONNABORTED) cerr << "接受连接失败" << endl;
+            return;
+        }
+        auto c = addConnection(cqe.res);
+        c->id = nextId++;
+        UringConn& u = ioConns[c->id];
+        u.conn = c;
+        if (!armRecv(c->id, u)) closeConn(c);
+    }
+
+    void onReceive(uint64_t id, const io_uring_cqe& cqe) {
+        bool hasBuffer = cqe.flags & IORING_CQE_F_BUFFER;
+        unsigned bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        auto it = ioConns.find(id);
+        if (it == ioConns.end()) {
+            if (hasBuffer) buffers.recycle(bufferId);
+            return;
+        }
+        UringConn& u = it->second;
+        shared_ptr<Connection> c = u.conn;
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            u.receiving = false;
+            u.cancelling = false;
+            u.outstanding--;
+        }
+        if (cqe.res > 0 && !c->closed && !c->draining) {  // 已决定关闭时丢弃后续数据
+            c->lastActive = time(nullptr);
+            consume(c, buffers.data(bufferId), cqe.res);
+        }
+        if (hasBuffer) buffers.recycle(bufferId);
+        if (!c->closed) {
+            if (cqe.res == 0) {
+                c->peerClosed = true;
+            } else if (cqe.res == -EINVAL && multishotRecv) {
+                multishotRecv = false;
+            } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {  // 缓冲区暂时用完时重新提交即可
+                closeConn(c);
+            }
+        }
+        if (!c->closed && !c->draining && backlogged(*c)) {
+            // 积压：不再提交接收，仍在进行的多次接收取消掉，由 startReading 恢复
+            c->readPaused = true;
+            if (u.receiving && !u.cancelling) cancelRecv(id, u);
+        }
+        if (!c->closed && !c->peerClosed && !u.receiving && !c->readPaused && !armRecv(id, u)) closeConn(c);
+        if (!c->closed && c->peerClosed && c->idle()) closeConn(c);
+        forgetIfDone(id);
+    }
+
+    void onWritten(uint64_t id, const io_uring_cqe& cqe) {
+        auto it = ioConns.find(id);
+        if (it == ioConns.end()) return;
+        UringConn& u = it->second;
+        u.outstanding--;
+        if (u.conn->closed) {
+            u.writeOp = 0;
+            forgetIfDone(id);
+            return;
+        }
+        u.writeDone = true;
+        u.writeResult = cqe.res;
+        shared_ptr<Connection> c = u.conn;
+        c->writable.wake();
+        forgetIfDone(id);
+    }
+
+    void onCompletion(const io_uring_cqe& cqe) {
+        uint64_t op = cqe.user_data >> 56;
+        uint64_t id = cqe.user_data & ((1ULL << 56) - 1);
+        switch (op) {
+            case OP_ACCEPT: onAccept(cqe); break;
+            case OP_WAKE:
+                runPosted();
+                if (!(cqe.flags & IORING_CQE_F_MORE)) armWake();
+                break;
+            case OP_TIMER: armTimer(); break;
+            case OP_RECV: onReceive(id, cqe); break;
+            case OP_SEND:
+            case OP_READ_FILE: onWritten(id, cqe); break;
+            default: break;
+        }
+    }
+
+    // 先取消连接上仍在进行的操作（如多次接收），再关闭套接字；
+    // 硬链接保证取消不到任何操作时关闭照常进行
+    void release(const shared_ptr<Connection>& c) override {
+        io_uring_sqe* cancel = prepare(OP_CLOSE, c->id, IORING_OP_ASYNC_CANCEL, c->fd);
+        io_uring_sqe* closing = cancel ? ring.sqe() : nullptr;
+        if (!closing) {  // 提交队列已满，直接关闭
+            shutdown(c->fd, SHUT_RDWR);
+            close(c->fd);
+            return;
+        }
+        cancel->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        cancel->flags = IOSQE_IO_HARDLINK;
+        closing->opcode = IORING_OP_CLOSE;
+        closing->fd = c->fd;
+        closing->user_data = userData(OP_CLOSE, c->id);
+    }
+
+    // 取走已完成的写出操作的结果
+    bool takeWrite(UringConn& u, uint64_t op, ssize_t& n) {
+        if (!u.writeDone || u.writeOp != op) return false;
+        u.writeDone = false;
+        u.writeOp = 0;
+        n = u.writeResult;
+        if (n < 0) {
+            errno = -u.writeResult;
+            n = -1;
+        }
+        return true;
+    }
+
+    bool startWrite(UringConn& u, Op op, uint8_t opcode, int fd, const void* addr, size_t len, uint64_t offset) {
+        io_uring_sqe* sqe = prepare(op, u.conn->id, opcode, fd);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)addr;
+        sqe->len = (uint32_t)len;
+        sqe->off = offset;
+        u.writeOp = op;
+        u.outstanding++;
+        return true;
+    }
+
+    static ssize_t wouldBlock() {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    ssize_t sendMemory(Connection& c, const iovec* iov, int count) override {
+        UringConn& u = ioConns.at(c.id);
+        ssize_t n;
+        if (takeWrite(u, OP_SEND, n)) return n;
+        if (u.writeOp) return wouldBlock();
+        copy(iov, iov + count, u.iov);
+        if (!startWrite(u, OP_SEND, IORING_OP_WRITEV, c.fd, u.iov, count, 0)) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        return wouldBlock();
+    }
+
+    void fileStarting(Connection& c) override { ioConns.at(c.id).fileBufferLength = 0; }
+
+    // 没有对应sendfile的操作：文件内容分段读入连接的缓冲区，再从缓冲区发送
+    ssize_t sendFile(Connection& c, const HttpResponse& r) override {
+        UringConn& u = ioConns.at(c.id);
+        ssize_t n;
+        if (takeWrite(u, OP_SEND, n)) return n;
+        if (takeWrite(u, OP_READ_FILE, n)) {
+            if (n <= 0) return n;  // 读到文件末尾说明文件被截断，由 flush 关闭连接
+            u.fileBufferStart = c.fileSent;
+            u.fileBufferLength = n;
+        }
+        if (u.writeOp) return wouldBlock();
+        bool started;
+        if (c.fileSent >= u.fileBufferStart && c.fileSent < u.fileBufferStart + u.fileBufferLength) {
+            size_t skip = c.fileSent - u.fileBufferStart;
+            started = startWrite(u, OP_SEND, IORING_OP_SEND, c.fd, u.fileBuffer.data() + skip,
+                                 u.fileBufferLength - skip, 0);
+        } else {
+            u.fileBuffer.resize(FILE_BUFFER_BYTES);
+            u.fileBufferLength = 0;
+            started = startWrite(u, OP_READ_FILE, IORING_OP_READ, r.fileFd, u.fileBuffer.data(),
+                                 min(FILE_BUFFER_BYTES, r.fileLength - c.fileSent), r.fileOffset + c.fileSent);
+        }
+        if (!started) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        return wouldBlock();
+    }
+
+public:
+    UringServer(int fd, ThreadPool& p, const ServerConfig& cfg) : EventServer(fd, p, cfg) {}
+
+    ~UringServer() override {
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    // 内核不支持io_uring（或其缓冲区环，5.19起）时返回false，由调用方改用epoll
+    bool init() {
+        return ring.init(RING_ENTRIES) && buffers.init(ring, RECV_GROUP, RECV_BUFFERS, RECV_BUFFER_BYTES) &&
+               createWakeFd() && armAccept() && armWake() && armTimer() && ring.submit() >= 0;
+    }
+
+    void run() {
+        time_t lastSweep = time(nullptr);
+        while (true) {
+            if (ring.submit(1) < 0 && errno != EINTR && errno != EBUSY) {
+                cerr << "io_uring_enter失败" << endl;
+                return;
+            }
+            ring.forEachCompletion([this](const io_uring_cqe& cqe) { onCompletion(cqe); });
+            if (time(nullptr) != lastSweep) {
+                lastSweep = time(nullptr);
+                closeIdle();
+            }
+        }
+    }
+};
+#endif
+
+// 创建绑定到配置端口的监听套接字，失败返回-1。
+// reusePort 时设置 SO_REUSEPORT，多个分片各自的监听套接字可以绑定同一端口
+int openListener(const ServerConfig& config, bool reusePort) {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        cerr << "无法创建套接字" << endl;
+        return -1;
+    }
+    
+    int opt = 1;
+#ifdef _WIN32
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+#else
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#endif
+#ifdef __linux__
+    if (reusePort && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        cerr << "无法设置SO_REUSEPORT" << endl;
+        closeSocket(server_fd);
+        return -1;
+    }
+#else
+    (void)reusePort;
+#endif
+
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(config.port);
+    
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        cerr << "绑定失败" << endl;
+        closeSocket(server_fd);
+        return -1;
+    }
+    
+    if (listen(server_fd, config.listenBacklog) < 0) {
+        cerr << "监听失败" << endl;
+        closeSocket(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+#ifdef __linux__
+// 按配置先试io_uring，不可用时改用epoll，运行事件循环；两者都无法初始化时返回false
+bool runEventLoop(int server_fd, ThreadPool& pool, const ServerConfig& config) {
+    if (config.ioBackend == "io_uring") {
+        UringServer uring(server_fd, pool, config);
+        if (uring.init()) {
+            if (!currentShard) cout << "使用io_uring事件循环" << endl;
+            uring.run();
+            return true;
+        }
+        cerr << "io_uring不可用，改用epoll" << endl;
+    }
+    EpollServer reactor(server_fd, pool, config);
+    if (!reactor.init()) return false;
+    reactor.run();
+    return true;
+}
+
+// 把当前线程绑定到一个CPU上
+void pinToCpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// 进程可以使用的CPU（受 taskset、cgroup 等限制）
+vector<int> allowedCpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty()) cpus.push_back(0);
+    return cpus;
+}
+
+// 运行一个分片：事件循环线程和它的工作线程都绑在同一个CPU上。
+// 缓存和分析表副本在绑定之后才创建，内存按首次访问分配在该CPU所在的NUMA节点
+void runShard(int server_fd, int cpu, size_t workers, size_t maxQueued, const ServerConfig& config) {
+    pinToCpu(cpu);
+    ServerShard shard(config.resultCacheBytes / config.shards);
+    shard.statics.preload();
+    shard.enter();
+    ThreadPool pool(workers, maxQueued, [&shard, cpu] {
+        pinToCpu(cpu);
+        shard.enter();
+    });
+    shard.pool = &pool;
+    {
+        lock_guard<mutex> lock(shardsMtx);
+        runningShards.push_back(&shard);
+    }
+    bool ran = runEventLoop(server_fd, pool, config);
+    {
+        lock_guard<mutex> lock(shardsMtx);
+        runningShards.erase(find(runningShards.begin(), runningShards.end(), &shard));
+    }
+    // 不再接受连接的分片必须关闭监听套接字，否则内核仍会把新连接分给它
+    close(server_fd);
+    if (!ran) cerr << "分片的事件循环初始化失败" << endl;
+}
+
+// 分片模式：每个分片有自己的 SO_REUSEPORT 监听套接字（都绑定同一端口，由内核按连接的地址哈希分配）、
+// 事件循环、线程池、结果缓存、静态资源缓存和分析表副本，彼此之间不共享数据，
+// 各分片依次绑在进程可用的CPU上
+void runShards(const ServerConfig& config) {
+    signal(SIGPIPE, SIG_IGN);
+    vector<int> fds;
+    for (int i = 0; i < config.shards; ++i) {
+        int fd = openListener(config, true);
+        if (fd < 0) {
+            for (int opened : fds) close(opened);
+            return;
+        }
+        fds.push_back(fd);
+    }
+    resultCache.setCapacity(0);  // 各分片用自己的缓存，全局缓存不再使用
+
+    vector<int> cpus = allowedCpus();
+    size_t workers = max<size_t>(1, config.workerThreads / config.shards);
+    size_t maxQueued = config.maxQueuedRequests ? max<size_t>(1, config.maxQueuedRequests / config.shards) : 0;
+    cout << "服务器启动在 http://localhost:" << config.port << "（分片: " << config.shards
+         << "，每个分片的工作线程: " << workers << "）" << endl;
+    vector<thread> loops;
+    for (int i = 0; i < config.shards; ++i) {
+        loops.emplace_back(runShard, fds[i], cpus[i % cpus.size()], workers, maxQueued, cref(config));
+    }
+    for (auto& loop : loops) loop.join();
+}
+#endif
+
+// 简单的HTTP服务器：Linux下使用epoll（或io_uring）事件循环，其他平台由接受线程把连接交给线程池
+void startServer(const ServerConfig& config) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        cerr << "WSAStartup failed" << endl;
+        return;
+    }
+#endif
+
+#ifdef __linux__
+    if (config.shards > 1) {
+        runShards(config);
+        return;
+    }
+#endif
+
+    int server_fd = openListener(config, false);
+    if (server_fd < 0) return;
+    
+    ThreadPool pool(config.workerThreads, config.maxQueuedRequests);
+    workerPool = &pool;
+    cout << "服务器启动在 http://localhost:" << config.port
+         << "（工作线程: " << pool.size() << "）" << endl;
+
+#ifdef __linux__
+    signal(SIGPIPE, SIG_IGN);
+    if (runEventLoop(server_fd, pool, config)) return;
+    cerr << "epoll初始化失败，改用阻塞模式" << endl;
+    int flags = fcntl(server_fd, F_GETFL, 0);
+    fcntl(server_fd, F_SETFL, flags & ~O_NONBLOCK);
+#endif
+    
+    while (true) {
+        int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            cerr << "接受连接失败" << endl;
+            continue;
+        }
+        
+        if (!pool.trySubmit([client_fd, &config] { handleClient(client_fd, config); })) {
+            // 线程池已满：不读取请求，直接回复503并关闭
+            metrics.shedRequests++;
+            HttpResponse response = overloadedResponse();
+            addConnectionHeaders(response, false, config);
+            sendResponse(client_fd, response);
+            closeSocket(client_fd);
+        }
+    }
+    
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// 解析命令行参数：--port=N --threads=N --keepalive-timeout=秒 --max-requests=N
+//                 --max-header-bytes=N --max-body-bytes=N --cache-bytes=N
+//                 --backlog=N --max-queue=N --request-timeout-ms=N --request-cpu-ms=N
+//                 --ws-idle-timeout=秒 --io=epoll|io_uring --shards=N
+ServerConfig parseArgs(int argc, char* argv[]) {
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--port") {
+            config.port = atoi(value.c_str());
+        } else if (key == "--threads") {
+            config.workerThreads = (size_t)max(1, atoi(value.c_str()));
+        } else if (key == "--keepalive-timeout") {
+            config.keepAliveTimeout = max(1, atoi(value.c_str()));
+        } else if (key == "--max-requests") {
+            config.maxRequestsPerConnection = max(1, atoi(value.c_str()));
+        } else if (key == "--max-header-bytes") {
+            config.maxHeaderBytes = (size_t)max(1024LL, atoll(value.c_str()));
+        } else if (key == "--max-body-bytes") {
+            config.maxBodyBytes = (size_t)max(0LL, atoll(value.c_str()));
+        } else if (key == "--cache-bytes") {
+            config.resultCacheBytes = (size_t)max(0LL, atoll(value.c_str()));
+        } else if (key == "--backlog") {
+            config.listenBacklog = max(1, atoi(value.c_str()));
+        } else if (key == "--max-queue") {
+            config.maxQueuedRequests = (size_t)max(0LL, atoll(value.c_str()));
+        } else if (key == "--request-timeout-ms") {
+            config.requestTimeoutMs = max(0L, atol(value.c_str()));
+        } else if (key == "--request-cpu-ms") {
+            config.requestCpuMs = max(0L, atol(value.c_str()));
+        } else if (key == "--ws-idle-timeout") {
+            config.webSocketIdleTimeout = max(1, atoi(value.c_str()));
+        } else if (key == "--io") {
+            if (value == "epoll" || value == "io_uring") config.ioBackend = value;
+            else cerr << "未知的I/O后端: " << value << endl;
+        } else if (key == "--shards") {
+            config.shards = max(1, atoi(value.c_str()));
+        } else {
+            cerr << "未知参数: " << arg << endl;
+        }
+    }
+    return config;
+}
+
+int main(int argc, char* argv[]) {
+    ServerConfig config = parseArgs(argc, argv);
+
+    // Generate LL(1) Table
+    cout << "Generating LL(1) Table..." << endl;
+    generateLLTableData(LLGrammar, LLTerminals, LLParseTable);
     
     // Generate LR Table
     cout << "Generating LR Table..." << endl;
     generateLRTableData(grammar_rules, action_table, goto_table, reduction_rules);
+
+    grammarVersion = tableFingerprint();
+    resultCache.setCapacity(config.resultCacheBytes);
+
+    cout << "Loaded " << staticCache.preload() << " static files" << endl;
     
-    startServer();
+    startServer(config);
     return 0;
 }
@@ -0,0 +1,64 @@
+// 实时分析：编辑器内容经 WebSocket 以增量方式发给服务器，服务器推送各阶段的最新结果。
+// 用法：connectLive(textarea, ['lrparse'], (stage, result) => { ... })
+function connectLive(editor, stages, onResult) {
+    let socket = null;
+    let sent = null;   // 服务器上文档的内容；null 表示需要重新发送完整文档
+    let version = 0;
+    let timer = null;
+
+    function open() {
+        let opened = false;
+        socket = new WebSocket('ws://localhost:8080/ws');
+        socket.onopen = () => {
+            opened = true;
+            sent = null;
+            sync();
+        };
+        socket.onmessage = (event) => {
+            const msg = JSON.parse(event.data);
+            if (msg.type === 'result') {
+                if (msg.version === version) onResult(msg.stage, msg.result);
+            } else if (msg.type === 'error') {
+                console.warn('实时分析:', msg.message);
+                sent = null;  // 与服务器不同步，下次重新发送完整文档
+            }
+        };
+        socket.onclose = () => {
+            socket = null;
+            if (opened) setTimeout(open, 3000);  // 服务器不支持时不再重试
+        };
+    }
+
+    // 只发送与上次不同的部分：公共前缀与公共后缀之间的片段（偏移按UTF-16码元计）
+    function sync() {
+        if (!socket || socket.readyState !== WebSocket.OPEN) return;
+        const code = editor.value;
+        if (sent === null) {
+            version++;
+            socket.send(JSON.stringify({ type: 'open', code, stages, version }));
+        } else if (code !== sent) {
+            const max = Math.min(code.length, sent.length);
+            let start = 0;
+            while (start < max && code[start] === sent[start]) start++;
+            let end = 0;
+            while (end < max - start && code[code.length - 1 - end] === sent[sent.length - 1 - end]) end++;
+            // 不把代理对拆开
+            if (start > 0 && /[\uD800-\uDBFF]/.test(sent[start - 1])) start--;
+            if (end > 0 && /[\uDC00-\uDFFF]/.test(sent[sent.length - end])) end--;
+            version++;
+            socket.send(JSON.stringify({
+                type: 'edit', version, start, end: sent.length - end,
+                text: code.slice(start, code.length - end)
+            }));
+        } else {
+            return;
+        }
+        sent = code;
+    }
+
+    editor.addEventListener('input', () => {
+        clearTimeout(timer);
+        timer = setTimeout(sync, 150);
+    });
+    open();
+}